@@ -0,0 +1,127 @@
+/// \file
+/// \brief Declaration of the Histogram class
+/// \ingroup utility
+
+#ifndef Histogram_h
+#define Histogram_h
+
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+
+/// A Histogram counts (non-negative, integer) values, such as latencies
+/// in microseconds, in log-linear buckets:
+/// each power of 2 is divided into 2^Sub linear buckets
+/// so that percentiles are estimated within 1/2^Sub of their value.
+/// Recording a value is constant time without allocation.
+class Histogram {
+private:
+    enum {
+	Sub	= 3,
+	Subs	= 1 << Sub,
+	Buckets	= (64 - Sub + 1) * Subs
+    };
+    uint64_t	counts[Buckets];
+    uint64_t	count;
+    uint64_t	sum;
+    uint64_t	min;
+    uint64_t	max;
+
+    static size_t bucket(uint64_t value) {
+	if (value < Subs) return value;
+	int power = 63 - __builtin_clzll(value);	// floor(log2(value))
+	return (power - Sub + 1) * Subs
+	    + ((value >> (power - Sub)) & (Subs - 1));
+    }
+    static uint64_t lower(size_t bucket) {
+	if (bucket < Subs) return bucket;
+	int power = bucket / Subs + Sub - 1;
+	return (static_cast<uint64_t>(1) << power)
+	    + (static_cast<uint64_t>(bucket % Subs) << (power - Sub));
+    }
+    static uint64_t upper(size_t bucket) {
+	return Buckets - 1 == bucket ? UINT64_MAX : lower(bucket + 1) - 1;
+    }
+public:
+    Histogram() {clear();}
+
+    void clear() {
+	memset(counts, 0, sizeof counts);
+	count	= 0;
+	sum	= 0;
+	min	= UINT64_MAX;
+	max	= 0;
+    }
+
+    void record(uint64_t value) {
+	++counts[bucket(value)];
+	++count;
+	sum += value;
+	if (value < min) min = value;
+	if (value > max) max = value;
+    }
+
+    /// add the values recorded by another to ours
+    void merge(Histogram const & other) {
+	for (size_t b = 0; b < Buckets; ++b) counts[b] += other.counts[b];
+	count += other.count;
+	sum += other.sum;
+	if (other.min < min) min = other.min;
+	if (other.max > max) max = other.max;
+    }
+
+    uint64_t getCount() const {return count;}
+    uint64_t getSum() const {return sum;}
+
+    /// \return the count of values in buckets entirely at or below value
+    uint64_t countAtOrBelow(uint64_t value) const {
+	uint64_t cumulative = 0;
+	for (size_t b = 0; b < Buckets && upper(b) <= value; ++b) {
+	    cumulative += counts[b];
+	}
+	return cumulative;
+    }
+
+    //******************************************************************
+    uint64_t percentile(
+	double		p)	///< percentile (0 - 100)
+    const
+    /// \brief Estimate the value at percentile p
+    /// as the middle of the bucket it is in (within min and max).
+    /// \return the estimate (0 if nothing was recorded).
+    //******************************************************************
+    {
+	if (!count) return 0;
+	uint64_t rank = static_cast<uint64_t>(p / 100 * count + 0.5);
+	if (rank < 1)		rank = 1;
+	if (rank > count)	rank = count;
+	uint64_t cumulative = 0;
+	for (size_t b = 0; b < Buckets; ++b) {
+	    cumulative += counts[b];
+	    if (cumulative >= rank) {
+		uint64_t value = lower(b) + (upper(b) - lower(b)) / 2;
+		return value < min ? min : value > max ? max : value;
+	    }
+	}
+	return max;
+    }
+
+    /// print a summary of our count and percentiles
+    friend std::ostream & operator<<(
+	std::ostream &		o,
+	Histogram const &	h)
+    {
+	o << "n=" << std::dec << h.count;
+	if (h.count) {
+	    o	<< " min=" << h.min
+		<< " p50=" << h.percentile(50)
+		<< " p90=" << h.percentile(90)
+		<< " p99=" << h.percentile(99)
+		<< " max=" << h.max
+		<< " mean=" << h.sum / h.count;
+	}
+	return o;
+    }
+};
+
+#endif
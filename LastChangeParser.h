@@ -0,0 +1,148 @@
+/// \file
+/// \brief Declaration of the LastChangeParser class
+/// \ingroup utility
+
+#ifndef LastChangeParser_h
+#define LastChangeParser_h
+
+#include <cstdarg>
+
+#include <libgupnp-av/gupnp-av.h>
+
+#include "LastChangeScanner.h"
+
+/// A LastChangeParser parses LastChange XML like the generic (gupnp-av)
+/// parser, with the same (name, type, pointer) arguments, but uses
+/// a LastChangeScanner and falls back to the generic parser
+/// only on what the scanner does not expect.
+class LastChangeParser {
+private:
+    GUPnPLastChangeParser *	lastChangeParser;
+    LastChangeScanner		scanner;
+
+    LastChangeParser(LastChangeParser const &);
+    LastChangeParser & operator=(LastChangeParser const &);
+
+    //******************************************************************
+    LastChangeScanner::Result scan(
+	guint		instance,
+	char const *	lastChangeXml,
+	std::va_list	args)
+    /// \brief Scan lastChangeXml for the (name, type, pointer) args
+    /// of instance and, if Found, set the values of those reported.
+    /// \return the scanner's result (or Unexpected, if not convertible).
+    //******************************************************************
+    {
+	char const *	names[LastChangeScanner::Variables];
+	GType		types[LastChangeScanner::Variables];
+	gpointer	pointers[LastChangeScanner::Variables];
+	size_t		count = 0;
+	while (char const * name = va_arg(args, char const *)) {
+	    if (LastChangeScanner::Variables == count) {
+		return LastChangeScanner::Unexpected;
+	    }
+	    names[count]	= name;
+	    types[count]	= va_arg(args, GType);
+	    pointers[count]	= va_arg(args, gpointer);
+	    ++count;
+	}
+	LastChangeScanner::Value values[LastChangeScanner::Variables];
+	LastChangeScanner::Result result = scanner.scan(
+	    lastChangeXml, instance, names, count, values);
+	if (LastChangeScanner::Found != result) {
+	    return result;
+	}
+	// convert all before setting any
+	union {
+	    bool		boolean;
+	    int			integer;
+	    unsigned int	unsigned_;
+	} converted[LastChangeScanner::Variables];
+	for (size_t i = 0; i < count; ++i) {
+	    if (!values[i].begin) continue;
+	    bool ok = false;
+	    switch (types[i]) {
+		case G_TYPE_BOOLEAN:
+		    ok = LastChangeScanner::toBoolean(
+			values[i], converted[i].boolean);
+		    break;
+		case G_TYPE_INT:
+		    ok = LastChangeScanner::toInteger(
+			values[i], converted[i].integer);
+		    break;
+		case G_TYPE_UINT:
+		    ok = LastChangeScanner::toUnsigned(
+			values[i], converted[i].unsigned_);
+		    break;
+		case G_TYPE_STRING:
+		    ok = true;
+		    break;
+	    }
+	    if (!ok) {
+		return LastChangeScanner::Unexpected;
+	    }
+	}
+	for (size_t i = 0; i < count; ++i) {
+	    if (!values[i].begin) continue;
+	    switch (types[i]) {
+		case G_TYPE_BOOLEAN:
+		    *static_cast<gboolean *>(pointers[i])
+			= converted[i].boolean;
+		    break;
+		case G_TYPE_INT:
+		    *static_cast<gint *>(pointers[i])
+			= converted[i].integer;
+		    break;
+		case G_TYPE_UINT:
+		    *static_cast<guint *>(pointers[i])
+			= converted[i].unsigned_;
+		    break;
+		case G_TYPE_STRING:
+		    *static_cast<char **>(pointers[i])
+			= g_strndup(values[i].begin, values[i].size);
+		    break;
+	    }
+	}
+	return result;
+    }
+protected:
+    /// called each time the generic parser is fallen back on
+    virtual void fellBack() {}
+public:
+    LastChangeParser()
+    :
+	lastChangeParser(gupnp_last_change_parser_new()),
+	scanner()
+    {}
+    virtual ~LastChangeParser() {g_object_unref(lastChangeParser);}
+
+    //******************************************************************
+    gboolean parseLastChange(
+	guint		instance,	///< InstanceID val of interest
+	char const *	lastChangeXml,	///< LastChange event
+	GError **	error,		///< set if the generic parser fails
+	...)				///< (name, type, pointer)s, 0
+    /// \brief Parse lastChangeXml as gupnp_last_change_parser_parse_last_change
+    /// would, falling back on it for what is Unexpected.
+    /// \return TRUE if instance was found.
+    //******************************************************************
+    {
+	std::va_list args;
+	va_start(args, error);
+	std::va_list scanArgs;
+	va_copy(scanArgs, args);
+	LastChangeScanner::Result scanned
+	    = scan(instance, lastChangeXml, scanArgs);
+	va_end(scanArgs);
+	gboolean result = LastChangeScanner::Found == scanned;
+	if (LastChangeScanner::Unexpected == scanned) {
+	    fellBack();
+	    result = gupnp_last_change_parser_parse_last_change_valist(
+		lastChangeParser, instance, lastChangeXml, error, args);
+	}
+	va_end(args);
+	return result;
+    }
+};
+
+#endif
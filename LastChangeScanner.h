@@ -0,0 +1,240 @@
+/// \file
+/// \brief Declaration of the LastChangeScanner class
+/// \ingroup utility
+
+#ifndef LastChangeScanner_h
+#define LastChangeScanner_h
+
+#include <cstddef>
+#include <cstring>
+#include <strings.h>
+
+/// A LastChangeScanner finds the val(ue)s of a few state variables
+/// of one instance in the XML of a UPnP AV LastChange event, such as
+///	<Event xmlns="urn:schemas-upnp-org:metadata-1-0/RCS/">
+///	    <InstanceID val="0">
+///		<Volume channel="Master" val="27"/>
+///		<Mute channel="Master" val="0"/>
+///	    </InstanceID>
+///	</Event>
+/// in a single pass, without building a document or allocating.
+/// Like the generic (gupnp-av) parser, the first element of a variable
+/// (e.g., that of the Master channel) is the one that is reported.
+/// Anything it does not expect (a DOCTYPE, CDATA, text content,
+/// an escaped val of interest, ...) is left for the generic parser.
+class LastChangeScanner {
+public:
+    enum {Variables = 8};	///< of interest, at most
+    enum Result {
+	Found,		///< instance (values of those reported)
+	NotFound,	///< instance
+	Unexpected	///< input (use the generic parser)
+    };
+    /// A Value is where (unescaped) val text is in the XML
+    struct Value {
+	char const *	begin;	///< 0 if its variable was not reported
+	size_t		size;
+    };
+private:
+    char const *	p;
+
+    static bool isSpace(char c) {
+	return ' ' == c || '\t' == c || '\n' == c || '\r' == c;
+    }
+    static bool isNameEnd(char c) {
+	return isSpace(c) || '/' == c || '>' == c || '=' == c || !c;
+    }
+    void skipSpace() {while (isSpace(*p)) ++p;}
+    /// skip <?...?> and <!--...--> (but not other <!...> markup)
+    bool skipMisc() {
+	for (;;) {
+	    skipSpace();
+	    if ('<' != *p) {
+		return true;
+	    } else if ('?' == p[1]) {
+		if (!(p = strstr(p + 2, "?>"))) return false;
+		p += 2;
+	    } else if (!strncmp(p, "<!--", 4)) {
+		if (!(p = strstr(p + 4, "-->"))) return false;
+		p += 3;
+	    } else {
+		return true;
+	    }
+	}
+    }
+    /// scan a name, returning its local (unprefixed) part
+    bool name(Value & local) {
+	char const * begin = p;
+	while (!isNameEnd(*p)) {
+	    if (':' == *p) begin = p + 1;
+	    ++p;
+	}
+	local.begin = begin;
+	local.size = p - begin;
+	return local.size;
+    }
+    static bool equals(Value const & value, char const * s) {
+	return !strncmp(value.begin, s, value.size) && !s[value.size];
+    }
+    //******************************************************************
+    bool tag(
+	Value &		local,	///< name of element
+	Value &		val,	///< value of its val attribute (or 0)
+	bool &		empty)	///< if it is an empty element tag
+    /// \brief Scan the rest of a start tag (after its <).
+    /// \return false if unexpected.
+    //******************************************************************
+    {
+	val.begin = 0;
+	if (!name(local)) return false;
+	for (;;) {
+	    skipSpace();
+	    if ('>' == *p) {
+		++p;
+		empty = false;
+		return true;
+	    }
+	    if ('/' == *p) {
+		if ('>' != *++p) return false;
+		++p;
+		empty = true;
+		return true;
+	    }
+	    Value attribute;
+	    if (!name(attribute)) return false;
+	    skipSpace();
+	    if ('=' != *p++) return false;
+	    skipSpace();
+	    char quote = *p++;
+	    if ('"' != quote && '\'' != quote) return false;
+	    char const * begin = p;
+	    if (!(p = strchr(p, quote))) return false;
+	    if (equals(attribute, "val")) {
+		val.begin = begin;
+		val.size = p - begin;
+	    }
+	    ++p;
+	}
+    }
+    /// scan the rest of an end tag (after its </)
+    bool endTag() {
+	Value local;
+	if (!name(local)) return false;
+	skipSpace();
+	return '>' == *p++;
+    }
+    static bool unsignedOf(Value const & value, unsigned long & result) {
+	if (!value.size || value.size > 9) return false;
+	result = 0;
+	for (size_t i = 0; i < value.size; ++i) {
+	    char c = value.begin[i];
+	    if ('0' > c || '9' < c) return false;
+	    result = result * 10 + (c - '0');
+	}
+	return true;
+    }
+public:
+    LastChangeScanner() : p(0) {}
+
+    //******************************************************************
+    Result scan(
+	char const *		xml,		///< LastChange event
+	unsigned int		instance,	///< InstanceID val of interest
+	char const * const	names[],	///< of variables of interest
+	size_t			count,		///< of names (<= Variables)
+	Value			values[])	///< of variables (out)
+    /// \brief Scan xml for the values of the named variables of instance.
+    /// \return Found, NotFound or Unexpected (values are meaningless).
+    //******************************************************************
+    {
+	if (!xml || count > Variables) return Unexpected;
+	for (size_t i = 0; i < count; ++i) values[i].begin = 0;
+	p = xml;
+	bool	instances	= false;	// any
+	bool	found		= false;	// ours
+	// <Event>
+	if (!skipMisc() || '<' != *p++) return Unexpected;
+	Value	local;
+	Value	val;
+	bool	empty;
+	if (!tag(local, val, empty) || !equals(local, "Event")) {
+	    return Unexpected;
+	}
+	if (!empty) for (;;) {
+	    // <InstanceID>s ... </Event>
+	    if (!skipMisc() || '<' != *p++) return Unexpected;
+	    if ('/' == *p) {
+		++p;
+		if (!endTag()) return Unexpected;
+		break;
+	    }
+	    if (!tag(local, val, empty) || !equals(local, "InstanceID")) {
+		return Unexpected;
+	    }
+	    unsigned long id;
+	    if (!val.begin || !unsignedOf(val, id)) return Unexpected;
+	    instances = true;
+	    bool ours = !found && instance == id;
+	    found = found || ours;
+	    if (!empty) for (;;) {
+		// variables ... </InstanceID>
+		if (!skipMisc() || '<' != *p++) return Unexpected;
+		if ('/' == *p) {
+		    ++p;
+		    if (!endTag()) return Unexpected;
+		    break;
+		}
+		if (!tag(local, val, empty) || !empty) return Unexpected;
+		if (!ours || !val.begin) continue;
+		for (size_t i = 0; i < count; ++i) {
+		    if (!values[i].begin && equals(local, names[i])) {
+			if (memchr(val.begin, '&', val.size)) {
+			    return Unexpected;
+			}
+			values[i] = val;
+			break;
+		    }
+		}
+	    }
+	}
+	if (!skipMisc() || *p || !instances) return Unexpected;
+	return found ? Found : NotFound;
+    }
+
+    /// \return true if value is an unsigned integer (result)
+    static bool toUnsigned(Value const & value, unsigned int & result) {
+	unsigned long result_;
+	if (!unsignedOf(value, result_)) return false;
+	result = result_;
+	return true;
+    }
+    /// \return true if value is an integer (result)
+    static bool toInteger(Value const & value, int & result) {
+	bool negative = value.size && '-' == *value.begin;
+	Value magnitude = {value.begin + negative, value.size - negative};
+	unsigned long result_;
+	if (!unsignedOf(magnitude, result_)) return false;
+	result = negative ? -static_cast<long>(result_) : result_;
+	return true;
+    }
+    /// \return true if value is a boolean (result)
+    static bool toBoolean(Value const & value, bool & result) {
+	static char const * const falses[] = {"0", "false", "no"};
+	static char const * const trues[]  = {"1", "true", "yes"};
+	for (size_t i = 0; i < sizeof falses / sizeof *falses; ++i) {
+	    if (value.size == strlen(falses[i])
+		    && !strncasecmp(value.begin, falses[i], value.size)) {
+		result = false;
+		return true;
+	    }
+	    if (value.size == strlen(trues[i])
+		    && !strncasecmp(value.begin, trues[i], value.size)) {
+		result = true;
+		return true;
+	    }
+	}
+	return false;
+    }
+};
+
+#endif
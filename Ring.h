@@ -0,0 +1,73 @@
+/// \file
+/// \brief Declaration of the Ring class template
+/// \ingroup utility
+
+#ifndef Ring_h
+#define Ring_h
+
+#include <atomic>
+#include <cstddef>
+
+/// A Ring is a bounded, lock-free, single producer, single consumer queue.
+/// One thread may push into it while another pops from it.
+/// Neither will ever block the other.
+template <typename T, size_t N>
+class Ring {
+    static_assert(N && !(N & (N - 1)), "Ring size must be a power of 2");
+private:
+    /// indices increase monotonically (modulo size_t overflow)
+    /// and are masked to index our slots.
+    /// each is padded onto its own cache line to prevent false sharing
+    /// (alignas would require over-aligned new, which c++0x lacks).
+    enum {CacheLine = 64};
+    std::atomic<size_t>	head;	///< next to pop (consumer)
+    char		headPad[CacheLine - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t>	tail;	///< next to push (producer)
+    char		tailPad[CacheLine - sizeof(std::atomic<size_t>)];
+    T			slots[N];
+public:
+    Ring() : head(0), tail(0) {}
+
+    //******************************************************************
+    bool push(
+	T const &	t)	///< value to push
+    /// \brief Push a copy of t (producer only).
+    /// \return false if full; otherwise, true.
+    //******************************************************************
+    {
+	size_t tail_ = tail.load(std::memory_order_relaxed);
+	if (N == tail_ - head.load(std::memory_order_acquire)) {
+	    return false;
+	}
+	slots[tail_ & (N - 1)] = t;
+	tail.store(tail_ + 1, std::memory_order_release);
+	return true;
+    }
+
+    //******************************************************************
+    bool pop(
+	T &		t)	///< value popped
+    /// \brief Pop the oldest value into t (consumer only).
+    /// \return false if empty; otherwise, true.
+    //******************************************************************
+    {
+	size_t head_ = head.load(std::memory_order_relaxed);
+	if (head_ == tail.load(std::memory_order_acquire)) {
+	    return false;
+	}
+	t = slots[head_ & (N - 1)];
+	head.store(head_ + 1, std::memory_order_release);
+	return true;
+    }
+
+    //******************************************************************
+    bool empty() const
+    /// \return true if there is nothing to pop (at this time).
+    //******************************************************************
+    {
+	return head.load(std::memory_order_acquire)
+	    == tail.load(std::memory_order_acquire);
+    }
+};
+
+#endif
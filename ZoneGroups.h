@@ -0,0 +1,59 @@
+/// \file
+/// \brief Declaration of the ZoneGroups class
+/// \ingroup utility
+
+#ifndef ZoneGroups_h
+#define ZoneGroups_h
+
+#include <map>
+#include <string>
+#include <unordered_map>
+
+/// ZoneGroups works out which renderers an operation is to be sent to
+/// when Sonos zones are grouped (as learned from ZoneGroupTopology).
+class ZoneGroups {
+public:
+    /// Coordinators maps each grouped zone to the zone coordinating it
+    typedef std::map<std::string, std::string> Coordinators;
+
+    //******************************************************************
+    template <typename Renderers>
+    static void coordinate(
+	Coordinators const &	coordinators,
+	Renderers &		renderers)	///< each with zone, selected,
+						///< coordinates, coordinatesOthers
+    /// \brief Work out which selected renderers coordinate themselves
+    /// (and others).
+    /// A renderer is its own coordinator unless it is grouped
+    /// with a selected renderer that coordinates it
+    /// (so that an operation for the renderers selected is never dropped).
+    //******************************************************************
+    {
+	std::unordered_map<std::string, size_t> zones;
+	for (size_t i = 0; i < renderers.size(); ++i) {
+	    if (renderers[i].selected) {
+		zones[renderers[i].zone] = i;
+	    }
+	    renderers[i].coordinates = true;
+	    renderers[i].coordinatesOthers = false;
+	}
+	for (size_t i = 0; i < renderers.size(); ++i) {
+	    if (!renderers[i].selected) continue;
+	    Coordinators::const_iterator it
+		= coordinators.find(renderers[i].zone);
+	    if (coordinators.end() == it) continue;
+	    std::unordered_map<std::string, size_t>::const_iterator jt
+		= zones.find(it->second);
+	    if (zones.end() != jt && i != jt->second) {
+		renderers[i].coordinates = false;
+		renderers[jt->second].coordinatesOthers = true;
+	    }
+	}
+	for (size_t i = 0; i < renderers.size(); ++i) {
+	    renderers[i].coordinatesOthers
+		= renderers[i].coordinatesOthers && renderers[i].coordinates;
+	}
+    }
+};
+
+#endif
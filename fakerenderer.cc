@@ -0,0 +1,760 @@
+/// \file
+/// \brief Definition of fakerenderer program
+///
+/// A fakerenderer stands in for UPnP AV media renderers (e.g., Sonos)
+/// so that r2upnpav may be measured without them.
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <list>
+#include <random>
+#include <sstream>
+
+// boost program options (link requires boost program_options library)
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/variables_map.hpp>
+#include <boost/program_options/parsers.hpp>
+
+#include <boost/shared_ptr.hpp>
+
+#include <signal.h>
+#include <unistd.h>
+
+#include <glib-unix.h>
+
+#include <libgupnp/gupnp.h>
+
+/// A Configuration is shared by all fake Renderers
+/// to tell how they should respond to actions.
+class Configuration {
+private:
+    std::mt19937				random;
+    std::uniform_int_distribution<unsigned int>	jitterDistribution;
+    std::uniform_real_distribution<double>	errorDistribution;
+public:
+    size_t		verbose;
+    unsigned int	delay;		///< milliseconds before response
+    double		errors;		///< rate of error responses (0 - 1)
+    Configuration(
+	size_t		verbose_,
+	unsigned int	delay_,
+	unsigned int	jitter,
+	double		errors_,
+	unsigned int	seed)
+    :
+	random(seed),
+	jitterDistribution(0, jitter),
+	errorDistribution(0, 1),
+	verbose(verbose_),
+	delay(delay_),
+	errors(errors_)
+    {}
+    /// \return milliseconds to delay the next response
+    unsigned int nextDelay() {
+	return delay + jitterDistribution(random);
+    }
+    /// \return true if the next response should be an error
+    bool nextError() {
+	return errors > errorDistribution(random);
+    }
+};
+
+/// A Directory is created to hold the description documents
+/// of all fake Renderers while they are served
+/// and is removed (with them) when destroyed.
+class Directory {
+private:
+    std::string			path;
+    std::list<std::string>	files;
+public:
+    Directory() throw(std::runtime_error)
+    :
+	path(),
+	files()
+    {
+	char path_[] = "/tmp/fakerendererXXXXXX";
+	if (!mkdtemp(path_)) {
+	    throw std::runtime_error("mkdtemp failed");
+	}
+	path = path_;
+    }
+    char const * getPath() const {return path.c_str();}
+    void write(char const * name, std::string const & content)
+	throw(std::runtime_error)
+    {
+	std::string file(path + "/" + name);
+	std::ofstream stream(file.c_str());
+	stream << content;
+	if (!stream) {
+	    throw std::runtime_error("cannot write " + file);
+	}
+	files.push_back(file);
+    }
+    ~Directory() {
+	for (std::list<std::string>::iterator it = files.begin();
+		files.end() != it; ++it) {
+	    unlink(it->c_str());
+	}
+	rmdir(path.c_str());
+    }
+};
+
+/// A Renderer object is created for each fake MediaRenderer device.
+/// It offers AVTransport and RenderingControl services
+/// (with the Sonos SetRelativeVolume extension),
+/// keeps their state and events it through LastChange.
+/// Each action is responded to after a configured delay (and jitter)
+/// or, at a configured rate, failed.
+class Renderer {
+public:
+    static char const * const avTransportScpd;
+    static char const * const renderingControlScpd;
+private:
+    /// A Response is created for each action invoked
+    /// and deletes itself when responded to.
+    class Response {
+    private:
+	Renderer &		renderer;
+	GUPnPService *		service;
+	GUPnPServiceAction *	action;
+	gboolean respond() {
+	    renderer.respond(service, action);
+	    delete this;
+	    return false;
+	}
+	static gboolean respondThat(gpointer that) {
+	    return static_cast<Response *>(that)->respond();
+	}
+    public:
+	Response(
+	    Renderer &			renderer_,
+	    GUPnPService *		service_,
+	    GUPnPServiceAction *	action_)
+	:
+	    renderer(renderer_),
+	    service(service_),
+	    action(action_)
+	{
+	    g_timeout_add(renderer.configuration.nextDelay(),
+		respondThat, this);
+	}
+    };
+
+    Configuration &	configuration;
+    std::string		name;
+    GUPnPRootDevice *	device;
+    bool		available;
+    GUPnPService *	avTransport;
+    GUPnPService *	renderingControl;
+    std::string		transportState;
+    gboolean		mute;
+    guint		volume;
+
+    std::string avTransportLastChange() const {
+	std::ostringstream o;
+	o << "<Event xmlns=\"urn:schemas-upnp-org:metadata-1-0/AVT/\">"
+	    << "<InstanceID val=\"0\">"
+	    << "<TransportState val=\"" << transportState << "\"/>"
+	    << "</InstanceID></Event>";
+	return o.str();
+    }
+    std::string renderingControlLastChange() const {
+	std::ostringstream o;
+	o << "<Event xmlns=\"urn:schemas-upnp-org:metadata-1-0/RCS/\">"
+	    << "<InstanceID val=\"0\">"
+	    << "<Volume channel=\"Master\" val=\"" << std::dec << volume
+		<< "\"/>"
+	    << "<Mute channel=\"Master\" val=\"" << (mute ? 1 : 0) << "\"/>"
+	    << "</InstanceID></Event>";
+	return o.str();
+    }
+    void notify(GUPnPService * service) {
+	std::string lastChange(avTransport == service
+	    ? avTransportLastChange()
+	    : renderingControlLastChange());
+	gupnp_service_notify(service,
+	    "LastChange", G_TYPE_STRING, lastChange.c_str(),
+	    NULL);
+    }
+    void setTransportState(char const * transportState_) {
+	if (transportState != transportState_) {
+	    transportState = transportState_;
+	    notify(avTransport);
+	}
+    }
+    void setVolume(int volume_) {
+	volume_ = 0 > volume_ ? 0 : 100 < volume_ ? 100 : volume_;
+	if (volume != static_cast<guint>(volume_)) {
+	    volume = volume_;
+	    notify(renderingControl);
+	}
+    }
+    void setMute(gboolean mute_) {
+	if (!mute != !mute_) {
+	    mute = mute_;
+	    notify(renderingControl);
+	}
+    }
+    void respond(GUPnPService * service, GUPnPServiceAction * action) {
+	char const * actionName = gupnp_service_action_get_name(action);
+	if (configuration.verbose) {
+	    std::cout << name << ": " << actionName << std::endl;
+	}
+	if (configuration.nextError()) {
+	    gupnp_service_action_return_error(action, 501, "Action Failed");
+	    return;
+	}
+	std::string action_(actionName);
+	if (avTransport == service) {
+	    if ("Play" == action_) {
+		setTransportState("PLAYING");
+	    } else if ("Pause" == action_) {
+		setTransportState("PAUSED_PLAYBACK");
+	    } else if ("Stop" == action_) {
+		setTransportState("STOPPED");
+	    } else if ("Next" == action_ || "Previous" == action_
+		    || "Seek" == action_) {
+	    } else if ("GetTransportInfo" == action_) {
+		gupnp_service_action_set(action,
+		    "CurrentTransportState", G_TYPE_STRING,
+			transportState.c_str(),
+		    "CurrentTransportStatus", G_TYPE_STRING, "OK",
+		    "CurrentSpeed", G_TYPE_STRING, "1",
+		    NULL);
+	    } else {
+		gupnp_service_action_return_error(action, 401,
+		    "Invalid Action");
+		return;
+	    }
+	} else {
+	    if ("GetMute" == action_) {
+		gupnp_service_action_set(action,
+		    "CurrentMute", G_TYPE_BOOLEAN, mute,
+		    NULL);
+	    } else if ("SetMute" == action_) {
+		gboolean mute_ = false;
+		gupnp_service_action_get(action,
+		    "DesiredMute", G_TYPE_BOOLEAN, &mute_,
+		    NULL);
+		setMute(mute_);
+	    } else if ("GetVolume" == action_) {
+		gupnp_service_action_set(action,
+		    "CurrentVolume", G_TYPE_UINT, volume,
+		    NULL);
+	    } else if ("SetVolume" == action_) {
+		guint volume_ = volume;
+		gupnp_service_action_get(action,
+		    "DesiredVolume", G_TYPE_UINT, &volume_,
+		    NULL);
+		setVolume(volume_);
+	    } else if ("SetRelativeVolume" == action_) {
+		gint adjustment = 0;
+		gupnp_service_action_get(action,
+		    "Adjustment", G_TYPE_INT, &adjustment,
+		    NULL);
+		setVolume(static_cast<int>(volume) + adjustment);
+		gupnp_service_action_set(action,
+		    "NewVolume", G_TYPE_UINT, volume,
+		    NULL);
+	    } else {
+		gupnp_service_action_return_error(action, 401,
+		    "Invalid Action");
+		return;
+	    }
+	}
+	gupnp_service_action_return(action);
+    }
+    static void actionInvokedThat(
+	GUPnPService *		service,
+	GUPnPServiceAction *	action,
+	gpointer		that)
+    {
+	new Response(*static_cast<Renderer *>(that), service, action);
+    }
+    /// initial event of a new subscription
+    void queryVariable(
+	GUPnPService *	service,
+	char const *	variable,
+	GValue *	value)
+    {
+	if (0 == strcmp("LastChange", variable)) {
+	    g_value_init(value, G_TYPE_STRING);
+	    g_value_set_string(value, (avTransport == service
+		? avTransportLastChange()
+		: renderingControlLastChange()).c_str());
+	}
+    }
+    static void queryVariableThat(
+	GUPnPService *	service,
+	char *		variable,
+	GValue *	value,
+	gpointer	that)
+    {
+	static_cast<Renderer *>(that)->queryVariable(service, variable, value);
+    }
+    GUPnPService * getService(char const * type) throw(std::runtime_error) {
+	GUPnPServiceInfo * service = gupnp_device_info_get_service(
+	    GUPNP_DEVICE_INFO(device), type);
+	if (!service) {
+	    throw std::runtime_error(name + ": no " + type);
+	}
+	g_signal_connect(service, "action-invoked",
+	    reinterpret_cast<GCallback>(actionInvokedThat), this);
+	g_signal_connect(service, "query-variable",
+	    reinterpret_cast<GCallback>(queryVariableThat), this);
+	return GUPNP_SERVICE(service);
+    }
+public:
+    Renderer(
+	Configuration &	configuration_,
+	GUPnPContext *	context,
+	Directory &	directory,
+	unsigned int	index,
+	std::string	name_)
+    throw(std::runtime_error)
+    :
+	configuration(configuration_),
+	name(name_),
+	device(0),
+	available(false),
+	avTransport(0),
+	renderingControl(0),
+	transportState("STOPPED"),
+	mute(false),
+	volume(20)
+    {
+	std::ostringstream file;
+	file << "Renderer" << std::dec << index << ".xml";
+	std::ostringstream description;
+	description
+	    << "<?xml version=\"1.0\"?>"
+	    << "<root xmlns=\"urn:schemas-upnp-org:device-1-0\">"
+	    << "<specVersion><major>1</major><minor>0</minor></specVersion>"
+	    << "<device>"
+	    << "<deviceType>urn:schemas-upnp-org:device:MediaRenderer:1"
+		<< "</deviceType>"
+	    << "<friendlyName>" << name << "</friendlyName>"
+	    << "<manufacturer>r2upnpav</manufacturer>"
+	    << "<modelName>fakerenderer</modelName>"
+	    << "<UDN>uuid:fakerenderer-" << index << "</UDN>"
+	    << "<serviceList>"
+	    << "<service>"
+	    << "<serviceType>urn:schemas-upnp-org:service:AVTransport:1"
+		<< "</serviceType>"
+	    << "<serviceId>urn:upnp-org:serviceId:AVTransport</serviceId>"
+	    << "<SCPDURL>/AVTransport.xml</SCPDURL>"
+	    << "<controlURL>/" << index << "/AVTransport/Control</controlURL>"
+	    << "<eventSubURL>/" << index << "/AVTransport/Event</eventSubURL>"
+	    << "</service>"
+	    << "<service>"
+	    << "<serviceType>urn:schemas-upnp-org:service:RenderingControl:1"
+		<< "</serviceType>"
+	    << "<serviceId>urn:upnp-org:serviceId:RenderingControl</serviceId>"
+	    << "<SCPDURL>/RenderingControl.xml</SCPDURL>"
+	    << "<controlURL>/" << index
+		<< "/RenderingControl/Control</controlURL>"
+	    << "<eventSubURL>/" << index
+		<< "/RenderingControl/Event</eventSubURL>"
+	    << "</service>"
+	    << "</serviceList>"
+	    << "</device>"
+	    << "</root>";
+	directory.write(file.str().c_str(), description.str());
+	GError * error = 0;
+	device = gupnp_root_device_new(context,
+	    file.str().c_str(), directory.getPath(), &error);
+	if (error) {
+	    boost::shared_ptr<GError> errorFree(error, g_error_free);
+	    throw std::runtime_error(error->message);
+	}
+	avTransport = getService(
+	    "urn:schemas-upnp-org:service:AVTransport:1");
+	renderingControl = getService(
+	    "urn:schemas-upnp-org:service:RenderingControl:1");
+	flap();
+    }
+    /// toggle our availability (announcing it)
+    void flap() {
+	available = !available;
+	gupnp_root_device_set_available(device, available);
+	if (configuration.verbose) {
+	    std::cout << name << (available ? ": available" : ": unavailable")
+		<< std::endl;
+	}
+    }
+    ~Renderer() {
+	gupnp_root_device_set_available(device, false);
+	g_object_unref(avTransport);
+	g_object_unref(renderingControl);
+	g_object_unref(device);
+    }
+};
+
+char const * const Renderer::avTransportScpd =
+"<?xml version=\"1.0\"?>"
+"<scpd xmlns=\"urn:schemas-upnp-org:service-1-0\">"
+"<specVersion><major>1</major><minor>0</minor></specVersion>"
+"<actionList>"
+"<action><name>Play</name><argumentList>"
+"<argument><name>InstanceID</name><direction>in</direction>"
+"<relatedStateVariable>A_ARG_TYPE_InstanceID</relatedStateVariable>"
+"</argument>"
+"<argument><name>Speed</name><direction>in</direction>"
+"<relatedStateVariable>TransportPlaySpeed</relatedStateVariable>"
+"</argument>"
+"</argumentList></action>"
+"<action><name>Pause</name><argumentList>"
+"<argument><name>InstanceID</name><direction>in</direction>"
+"<relatedStateVariable>A_ARG_TYPE_InstanceID</relatedStateVariable>"
+"</argument>"
+"</argumentList></action>"
+"<action><name>Stop</name><argumentList>"
+"<argument><name>InstanceID</name><direction>in</direction>"
+"<relatedStateVariable>A_ARG_TYPE_InstanceID</relatedStateVariable>"
+"</argument>"
+"</argumentList></action>"
+"<action><name>Next</name><argumentList>"
+"<argument><name>InstanceID</name><direction>in</direction>"
+"<relatedStateVariable>A_ARG_TYPE_InstanceID</relatedStateVariable>"
+"</argument>"
+"</argumentList></action>"
+"<action><name>Previous</name><argumentList>"
+"<argument><name>InstanceID</name><direction>in</direction>"
+"<relatedStateVariable>A_ARG_TYPE_InstanceID</relatedStateVariable>"
+"</argument>"
+"</argumentList></action>"
+"<action><name>Seek</name><argumentList>"
+"<argument><name>InstanceID</name><direction>in</direction>"
+"<relatedStateVariable>A_ARG_TYPE_InstanceID</relatedStateVariable>"
+"</argument>"
+"<argument><name>Unit</name><direction>in</direction>"
+"<relatedStateVariable>A_ARG_TYPE_SeekMode</relatedStateVariable>"
+"</argument>"
+"<argument><name>Target</name><direction>in</direction>"
+"<relatedStateVariable>A_ARG_TYPE_SeekTarget</relatedStateVariable>"
+"</argument>"
+"</argumentList></action>"
+"<action><name>GetTransportInfo</name><argumentList>"
+"<argument><name>InstanceID</name><direction>in</direction>"
+"<relatedStateVariable>A_ARG_TYPE_InstanceID</relatedStateVariable>"
+"</argument>"
+"<argument><name>CurrentTransportState</name><direction>out</direction>"
+"<relatedStateVariable>TransportState</relatedStateVariable>"
+"</argument>"
+"<argument><name>CurrentTransportStatus</name><direction>out</direction>"
+"<relatedStateVariable>TransportStatus</relatedStateVariable>"
+"</argument>"
+"<argument><name>CurrentSpeed</name><direction>out</direction>"
+"<relatedStateVariable>TransportPlaySpeed</relatedStateVariable>"
+"</argument>"
+"</argumentList></action>"
+"</actionList>"
+"<serviceStateTable>"
+"<stateVariable sendEvents=\"yes\"><name>LastChange</name>"
+"<dataType>string</dataType></stateVariable>"
+"<stateVariable sendEvents=\"no\"><name>TransportState</name>"
+"<dataType>string</dataType></stateVariable>"
+"<stateVariable sendEvents=\"no\"><name>TransportStatus</name>"
+"<dataType>string</dataType></stateVariable>"
+"<stateVariable sendEvents=\"no\"><name>TransportPlaySpeed</name>"
+"<dataType>string</dataType></stateVariable>"
+"<stateVariable sendEvents=\"no\"><name>A_ARG_TYPE_SeekMode</name>"
+"<dataType>string</dataType></stateVariable>"
+"<stateVariable sendEvents=\"no\"><name>A_ARG_TYPE_SeekTarget</name>"
+"<dataType>string</dataType></stateVariable>"
+"<stateVariable sendEvents=\"no\"><name>A_ARG_TYPE_InstanceID</name>"
+"<dataType>ui4</dataType></stateVariable>"
+"</serviceStateTable>"
+"</scpd>";
+
+char const * const Renderer::renderingControlScpd =
+"<?xml version=\"1.0\"?>"
+"<scpd xmlns=\"urn:schemas-upnp-org:service-1-0\">"
+"<specVersion><major>1</major><minor>0</minor></specVersion>"
+"<actionList>"
+"<action><name>GetMute</name><argumentList>"
+"<argument><name>InstanceID</name><direction>in</direction>"
+"<relatedStateVariable>A_ARG_TYPE_InstanceID</relatedStateVariable>"
+"</argument>"
+"<argument><name>Channel</name><direction>in</direction>"
+"<relatedStateVariable>A_ARG_TYPE_Channel</relatedStateVariable>"
+"</argument>"
+"<argument><name>CurrentMute</name><direction>out</direction>"
+"<relatedStateVariable>Mute</relatedStateVariable>"
+"</argument>"
+"</argumentList></action>"
+"<action><name>SetMute</name><argumentList>"
+"<argument><name>InstanceID</name><direction>in</direction>"
+"<relatedStateVariable>A_ARG_TYPE_InstanceID</relatedStateVariable>"
+"</argument>"
+"<argument><name>Channel</name><direction>in</direction>"
+"<relatedStateVariable>A_ARG_TYPE_Channel</relatedStateVariable>"
+"</argument>"
+"<argument><name>DesiredMute</name><direction>in</direction>"
+"<relatedStateVariable>Mute</relatedStateVariable>"
+"</argument>"
+"</argumentList></action>"
+"<action><name>GetVolume</name><argumentList>"
+"<argument><name>InstanceID</name><direction>in</direction>"
+"<relatedStateVariable>A_ARG_TYPE_InstanceID</relatedStateVariable>"
+"</argument>"
+"<argument><name>Channel</name><direction>in</direction>"
+"<relatedStateVariable>A_ARG_TYPE_Channel</relatedStateVariable>"
+"</argument>"
+"<argument><name>CurrentVolume</name><direction>out</direction>"
+"<relatedStateVariable>Volume</relatedStateVariable>"
+"</argument>"
+"</argumentList></action>"
+"<action><name>SetVolume</name><argumentList>"
+"<argument><name>InstanceID</name><direction>in</direction>"
+"<relatedStateVariable>A_ARG_TYPE_InstanceID</relatedStateVariable>"
+"</argument>"
+"<argument><name>Channel</name><direction>in</direction>"
+"<relatedStateVariable>A_ARG_TYPE_Channel</relatedStateVariable>"
+"</argument>"
+"<argument><name>DesiredVolume</name><direction>in</direction>"
+"<relatedStateVariable>Volume</relatedStateVariable>"
+"</argument>"
+"</argumentList></action>"
+"<action><name>SetRelativeVolume</name><argumentList>"
+"<argument><name>InstanceID</name><direction>in</direction>"
+"<relatedStateVariable>A_ARG_TYPE_InstanceID</relatedStateVariable>"
+"</argument>"
+"<argument><name>Channel</name><direction>in</direction>"
+"<relatedStateVariable>A_ARG_TYPE_Channel</relatedStateVariable>"
+"</argument>"
+"<argument><name>Adjustment</name><direction>in</direction>"
+"<relatedStateVariable>A_ARG_TYPE_VolumeAdjustment</relatedStateVariable>"
+"</argument>"
+"<argument><name>NewVolume</name><direction>out</direction>"
+"<relatedStateVariable>Volume</relatedStateVariable>"
+"</argument>"
+"</argumentList></action>"
+"</actionList>"
+"<serviceStateTable>"
+"<stateVariable sendEvents=\"yes\"><name>LastChange</name>"
+"<dataType>string</dataType></stateVariable>"
+"<stateVariable sendEvents=\"no\"><name>Mute</name>"
+"<dataType>boolean</dataType></stateVariable>"
+"<stateVariable sendEvents=\"no\"><name>Volume</name>"
+"<dataType>ui2</dataType></stateVariable>"
+"<stateVariable sendEvents=\"no\"><name>A_ARG_TYPE_Channel</name>"
+"<dataType>string</dataType></stateVariable>"
+"<stateVariable sendEvents=\"no\"><name>A_ARG_TYPE_VolumeAdjustment</name>"
+"<dataType>i4</dataType></stateVariable>"
+"<stateVariable sendEvents=\"no\"><name>A_ARG_TYPE_InstanceID</name>"
+"<dataType>ui4</dataType></stateVariable>"
+"</serviceStateTable>"
+"</scpd>";
+
+typedef std::list<boost::shared_ptr<Renderer> > Renderers;
+
+/// toggle the availability of renderers (on a timer)
+static gboolean flap(gpointer renderers) {
+    Renderers & renderers_ = *static_cast<Renderers *>(renderers);
+    for (Renderers::iterator it = renderers_.begin();
+	    renderers_.end() != it; ++it) {
+	(*it)->flap();
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+/// \return format with each %u replaced by index (and %% by %).
+/// format is not given to printf as it comes from the command line.
+static std::string friendlyName(std::string const & format, unsigned int index)
+{
+    std::ostringstream name;
+    for (std::string::size_type i = 0; format.size() > i; ++i) {
+	if ('%' == format[i] && format.size() > i + 1) {
+	    if ('u' == format[i + 1]) {
+		name << index;
+		++i;
+		continue;
+	    }
+	    if ('%' == format[i + 1]) {
+		++i;
+	    }
+	}
+	name << format[i];
+    }
+    return name.str();
+}
+
+/// quit loop (on SIGINT or SIGTERM)
+static gboolean quit(gpointer loop) {
+    g_main_loop_quit(static_cast<GMainLoop *>(loop));
+    return G_SOURCE_CONTINUE;
+}
+
+int main(int argc, char ** argv) {
+    static std::string const helpOption		("help");
+    static std::string const helpOptions	( helpOption		+ ",h");
+    static std::string const countOption	("count");
+    static std::string const countOptions	( countOption		+ ",c");
+    static std::string const delayOption	("delay");
+    static std::string const delayOptions	( delayOption		+ ",d");
+    static std::string const errorsOption	("errors");
+    static std::string const errorsOptions	( errorsOption		+ ",e");
+    static std::string const firstOption	("first");
+    static std::string const firstOptions	( firstOption		+ ",f");
+    static std::string const flapOption		("flap");
+    static std::string const interfaceOption	("interface");
+    static std::string const interfaceOptions	( interfaceOption	+ ",i");
+    static std::string const jitterOption	("jitter");
+    static std::string const jitterOptions	( jitterOption		+ ",j");
+    static std::string const nameOption		("name");
+    static std::string const nameOptions	( nameOption		+ ",n");
+    static std::string const seedOption		("seed");
+    static std::string const verboseOption	("verbose");
+    static std::string const verboseOptions	( verboseOption		+ ",v");
+
+    static unsigned int const countDefault	(1);
+    static unsigned int const delayDefault	(20);
+    static double const errorsDefault		(0);
+    static unsigned int const firstDefault	(1);
+    static std::string const interfaceDefault	("lo");
+    static unsigned int const jitterDefault	(10);
+    static std::string const nameDefault	("Fake %u - Sonos fakerenderer");
+    static unsigned int const seedDefault	(1);
+
+    try {
+	std::ostringstream countUsage; countUsage
+	    << "renderers to fake (default: " << countDefault << ").";
+	std::ostringstream delayUsage; delayUsage
+	    << "response delay in milliseconds (default: "
+	    << delayDefault << ").";
+	std::ostringstream errorsUsage; errorsUsage
+	    << "rate of error responses, 0 - 1 (default: "
+	    << errorsDefault << ").";
+	std::ostringstream firstUsage; firstUsage
+	    << "index of first renderer, for its name and UDN (default: "
+	    << firstDefault << ").";
+	std::ostringstream flapUsage; flapUsage
+	    << "milliseconds between toggles of renderer availability "
+	    << "(default: 0); 0 => always available.";
+	std::ostringstream interfaceUsage; interfaceUsage
+	    << "UPnP network (default: " << interfaceDefault << ").";
+	std::ostringstream jitterUsage; jitterUsage
+	    << "response delay jitter in milliseconds, at most (default: "
+	    << jitterDefault << ").";
+	std::ostringstream nameUsage; nameUsage
+	    << "renderer friendly name, with %u for its index (default: "
+	    << nameDefault << ").";
+	std::ostringstream seedUsage; seedUsage
+	    << "random seed for jitter and errors (default: "
+	    << seedDefault << ").";
+
+	boost::program_options::options_description options("Options");
+	    options.add_options()
+		(helpOptions.c_str(),
+		    "Print options usage.")
+		(countOptions.c_str(),
+		    boost::program_options::value<unsigned int>(),
+		    countUsage.str().c_str())
+		(delayOptions.c_str(),
+		    boost::program_options::value<unsigned int>(),
+		    delayUsage.str().c_str())
+		(errorsOptions.c_str(),
+		    boost::program_options::value<double>(),
+		    errorsUsage.str().c_str())
+		(firstOptions.c_str(),
+		    boost::program_options::value<unsigned int>(),
+		    firstUsage.str().c_str())
+		(flapOption.c_str(),
+		    boost::program_options::value<unsigned int>(),
+		    flapUsage.str().c_str())
+		(interfaceOptions.c_str(),
+		    boost::program_options::value<std::string>(),
+		    interfaceUsage.str().c_str())
+		(jitterOptions.c_str(),
+		    boost::program_options::value<unsigned int>(),
+		    jitterUsage.str().c_str())
+		(nameOptions.c_str(),
+		    boost::program_options::value<std::string>(),
+		    nameUsage.str().c_str())
+		(seedOption.c_str(),
+		    boost::program_options::value<unsigned int>(),
+		    seedUsage.str().c_str())
+		(verboseOptions.c_str(),
+		    "Print trace messages.")
+	;
+	boost::program_options::variables_map variablesMap;
+	boost::program_options::store(
+		boost::program_options::parse_command_line(argc, argv, options),
+	    variablesMap);
+	boost::program_options::notify(variablesMap);
+
+	if (variablesMap.count(helpOption)) {
+	    std::cout << options;
+	    return 0;
+	}
+
+	unsigned int count(variablesMap.count(countOption)
+	    ? variablesMap[countOption].as<unsigned int>()
+	    : countDefault);
+	unsigned int delay(variablesMap.count(delayOption)
+	    ? variablesMap[delayOption].as<unsigned int>()
+	    : delayDefault);
+	double errors(variablesMap.count(errorsOption)
+	    ? variablesMap[errorsOption].as<double>()
+	    : errorsDefault);
+	unsigned int first(variablesMap.count(firstOption)
+	    ? variablesMap[firstOption].as<unsigned int>()
+	    : firstDefault);
+	unsigned int flap_(variablesMap.count(flapOption)
+	    ? variablesMap[flapOption].as<unsigned int>()
+	    : 0);
+	std::string interface(variablesMap.count(interfaceOption)
+	    ? variablesMap[interfaceOption].as<std::string>()
+	    : interfaceDefault);
+	unsigned int jitter(variablesMap.count(jitterOption)
+	    ? variablesMap[jitterOption].as<unsigned int>()
+	    : jitterDefault);
+	std::string name(variablesMap.count(nameOption)
+	    ? variablesMap[nameOption].as<std::string>()
+	    : nameDefault);
+	unsigned int seed(variablesMap.count(seedOption)
+	    ? variablesMap[seedOption].as<unsigned int>()
+	    : seedDefault);
+	size_t verbose = variablesMap.count(verboseOption);
+
+	boost::shared_ptr<GMainLoop> loop(
+	    g_main_loop_new(0, true),
+	    g_main_loop_unref);
+
+	GError * error = 0;
+	boost::shared_ptr<GUPnPContext> context(
+	    gupnp_context_new(NULL, interface.c_str(), 0, &error),
+	    g_object_unref);
+	if (error) {
+	    boost::shared_ptr<GError> errorFree(error, g_error_free);
+	    throw std::runtime_error(error->message);
+	}
+
+	Configuration configuration(verbose, delay, jitter, errors, seed);
+	Directory directory;
+	directory.write("AVTransport.xml", Renderer::avTransportScpd);
+	directory.write("RenderingControl.xml",
+	    Renderer::renderingControlScpd);
+	Renderers renderers;
+	for (unsigned int index = first; first + count > index; ++index) {
+	    renderers.push_back(boost::shared_ptr<Renderer>(new Renderer(
+		configuration, context.get(), directory, index,
+		friendlyName(name, index))));
+	}
+
+	if (flap_) {
+	    g_timeout_add(flap_, flap, &renderers);
+	}
+	g_unix_signal_add(SIGINT,	quit,		loop.get());
+	g_unix_signal_add(SIGTERM,	quit,		loop.get());
+
+	g_main_loop_run(loop.get());
+
+    } catch (std::exception & e) {
+	std::cerr << e.what() << std::endl;
+	return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,314 @@
+/// \file
+/// \brief Definition of lastchangebench program
+///
+/// A lastchangebench measures the LastChangeParser that r2upnpav uses
+/// against the generic (gupnp-av) LastChange parser
+/// on LastChange events captured from Sonos renderers
+/// (and on some that it must fall back to the generic parser for).
+
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+// boost program options (link requires boost program_options library)
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/variables_map.hpp>
+#include <boost/program_options/parsers.hpp>
+
+#include <boost/shared_ptr.hpp>
+
+#include <libgupnp-av/gupnp-av.h>
+
+#include "LastChangeParser.h"
+
+/// A Payload is a captured LastChange event
+/// with the variables of interest in it (as r2upnpav asks for them)
+struct Payload {
+    char const *	name;
+    char const *	xml;
+    bool		transport;	///< TransportState (else Mute, Volume)
+    bool		fallback;	///< expected to the generic parser
+};
+
+static Payload const payloads[] = {
+    {"RenderingControl volume",
+"<Event xmlns=\"urn:schemas-upnp-org:metadata-1-0/RCS/\">"
+"<InstanceID val=\"0\">"
+"<Volume channel=\"Master\" val=\"27\"/>"
+"<Volume channel=\"LF\" val=\"100\"/>"
+"<Volume channel=\"RF\" val=\"100\"/>"
+"<Mute channel=\"Master\" val=\"0\"/>"
+"<Mute channel=\"LF\" val=\"0\"/>"
+"<Mute channel=\"RF\" val=\"0\"/>"
+"<Bass val=\"0\"/>"
+"<Treble val=\"0\"/>"
+"<Loudness channel=\"Master\" val=\"1\"/>"
+"<OutputFixed val=\"0\"/>"
+"<HeadphoneConnected val=\"0\"/>"
+"<SpeakerSize val=\"5\"/>"
+"<SubGain val=\"0\"/>"
+"<SubCrossover val=\"0\"/>"
+"<SubPolarity val=\"0\"/>"
+"<SubEnabled val=\"1\"/>"
+"<SonarEnabled val=\"0\"/>"
+"<SonarCalibrationAvailable val=\"0\"/>"
+"<PresetNameList val=\"FactoryDefaults\"/>"
+"</InstanceID>"
+"</Event>",
+	false, false},
+    {"RenderingControl held volume key",
+"<Event xmlns=\"urn:schemas-upnp-org:metadata-1-0/RCS/\">"
+"<InstanceID val=\"0\">"
+"<Volume channel=\"Master\" val=\"31\"/>"
+"</InstanceID>"
+"</Event>",
+	false, false},
+    {"AVTransport state",
+"<Event xmlns=\"urn:schemas-upnp-org:metadata-1-0/AVT/\""
+" xmlns:r=\"urn:schemas-rinconnetworks-com:metadata-1-0/\">"
+"<InstanceID val=\"0\">"
+"<TransportState val=\"PLAYING\"/>"
+"<CurrentPlayMode val=\"NORMAL\"/>"
+"<CurrentCrossfadeMode val=\"0\"/>"
+"<NumberOfTracks val=\"1\"/>"
+"<CurrentTrack val=\"1\"/>"
+"<CurrentSection val=\"0\"/>"
+"<CurrentTrackURI"
+" val=\"x-sonos-http:track%3a123.mp3?sid=9&amp;flags=8224\"/>"
+"<CurrentTrackDuration val=\"0:03:41\"/>"
+"<CurrentTrackMetaData val=\"&lt;DIDL-Lite"
+" xmlns:dc=&quot;http://purl.org/dc/elements/1.1/&quot;"
+" xmlns:upnp=&quot;urn:schemas-upnp-org:metadata-1-0/upnp/&quot;"
+" xmlns=&quot;urn:schemas-upnp-org:metadata-1-0/DIDL-Lite/&quot;&gt;"
+"&lt;item id=&quot;-1&quot; parentID=&quot;-1&quot;&gt;"
+"&lt;res protocolInfo=&quot;sonos.com-http:*:audio/mpeg:*&quot;"
+" duration=&quot;0:03:41&quot;&gt;x-sonos-http:track%3a123.mp3&lt;/res&gt;"
+"&lt;dc:title&gt;Title&lt;/dc:title&gt;"
+"&lt;upnp:class&gt;object.item.audioItem.musicTrack&lt;/upnp:class&gt;"
+"&lt;dc:creator&gt;Artist&lt;/dc:creator&gt;"
+"&lt;upnp:album&gt;Album&lt;/upnp:album&gt;"
+"&lt;/item&gt;&lt;/DIDL-Lite&gt;\"/>"
+"<r:NextTrackURI val=\"\"/>"
+"<r:NextTrackMetaData val=\"\"/>"
+"<r:EnqueuedTransportURI"
+" val=\"x-rincon-queue:RINCON_000E58000000001400#0\"/>"
+"<r:EnqueuedTransportURIMetaData val=\"\"/>"
+"<PlaybackStorageMedium val=\"NETWORK\"/>"
+"<AVTransportURI"
+" val=\"x-rincon-queue:RINCON_000E58000000001400#0\"/>"
+"<AVTransportURIMetaData val=\"\"/>"
+"<CurrentTransportActions"
+" val=\"Set, Stop, Pause, Play, Next, Previous\"/>"
+"<r:CurrentValidPlayModes val=\"SHUFFLE,REPEAT,CROSSFADE\"/>"
+"<TransportStatus val=\"OK\"/>"
+"<r:SleepTimerGeneration val=\"0\"/>"
+"<r:AlarmRunning val=\"0\"/>"
+"<r:SnoozeRunning val=\"0\"/>"
+"<r:RestartPending val=\"0\"/>"
+"<TransportPlaySpeed val=\"NOT_IMPLEMENTED\"/>"
+"</InstanceID>"
+"</Event>",
+	true, false},
+    {"AVTransport escaped state",
+"<Event xmlns=\"urn:schemas-upnp-org:metadata-1-0/AVT/\">"
+"<InstanceID val=\"0\">"
+"<TransportState val=\"PAUSED&#95;PLAYBACK\"/>"
+"</InstanceID>"
+"</Event>",
+	true, true},
+    {"RenderingControl CDATA",
+"<Event xmlns=\"urn:schemas-upnp-org:metadata-1-0/RCS/\">"
+"<InstanceID val=\"0\">"
+"<![CDATA[<Volume channel=\"Master\" val=\"99\"/>]]>"
+"<Volume channel=\"Master\" val=\"12\"/>"
+"<Mute channel=\"Master\" val=\"1\"/>"
+"</InstanceID>"
+"</Event>",
+	false, true},
+    {"RenderingControl text content",
+"<Event xmlns=\"urn:schemas-upnp-org:metadata-1-0/RCS/\">"
+"<InstanceID val=\"0\">"
+"<Volume channel=\"Master\" val=\"12\">12</Volume>"
+"<Mute channel=\"Master\" val=\"0\"/>"
+"</InstanceID>"
+"</Event>",
+	false, true},
+    {"RenderingControl other instance",
+"<Event xmlns=\"urn:schemas-upnp-org:metadata-1-0/RCS/\">"
+"<InstanceID val=\"1\">"
+"<Volume channel=\"Master\" val=\"12\"/>"
+"<Mute channel=\"Master\" val=\"1\"/>"
+"</InstanceID>"
+"</Event>",
+	false, false},
+};
+
+/// A Result is what r2upnpav would learn from a Payload
+struct Result {
+    gboolean	parsed;
+    gboolean	mute;
+    guint	volume;
+    char *	transportState;
+    Result()
+    :
+	parsed(FALSE),
+	mute(-1),
+	volume(G_MAXUINT),
+	transportState(0)
+    {}
+    ~Result() {g_free(transportState);}
+    bool operator==(Result const & that) const {
+	return parsed == that.parsed
+	    && mute == that.mute
+	    && volume == that.volume
+	    && (transportState && that.transportState
+		? !strcmp(transportState, that.transportState)
+		: transportState == that.transportState);
+    }
+    friend std::ostream & operator<<(std::ostream & o, Result const & r) {
+	return o << r.parsed << " " << r.mute << " " << r.volume << " "
+	    << (r.transportState ? r.transportState : "(null)");
+    }
+};
+
+static void generic(
+    GUPnPLastChangeParser *	parser,
+    Payload const &		payload,
+    Result &			result)
+{
+    GError * error = 0;
+    result.parsed = payload.transport
+	? gupnp_last_change_parser_parse_last_change(parser,
+	    0, payload.xml, &error,
+	    "TransportState",	G_TYPE_STRING,	&result.transportState,
+	    NULL)
+	: gupnp_last_change_parser_parse_last_change(parser,
+	    0, payload.xml, &error,
+	    "Mute",		G_TYPE_BOOLEAN,	&result.mute,
+	    "Volume",		G_TYPE_UINT,	&result.volume,
+	    NULL);
+    if (error) g_error_free(error);
+}
+
+/// A CountingParser is the LastChangeParser r2upnpav uses,
+/// counting the times it falls back to the generic parser
+class CountingParser : public LastChangeParser {
+protected:
+    void fellBack() {++fallbacks;}
+public:
+    unsigned int	fallbacks;
+    CountingParser() : fallbacks(0) {}
+};
+
+/// parse as r2upnpav does
+static void scanned(
+    LastChangeParser &		parser,
+    Payload const &		payload,
+    Result &			result)
+{
+    GError * error = 0;
+    result.parsed = payload.transport
+	? parser.parseLastChange(
+	    0, payload.xml, &error,
+	    "TransportState",	G_TYPE_STRING,	&result.transportState,
+	    NULL)
+	: parser.parseLastChange(
+	    0, payload.xml, &error,
+	    "Mute",		G_TYPE_BOOLEAN,	&result.mute,
+	    "Volume",		G_TYPE_UINT,	&result.volume,
+	    NULL);
+    if (error) g_error_free(error);
+}
+
+/// \return nanoseconds per call of f
+template <typename F>
+static double measure(unsigned int iterations, F f) {
+    gint64 begin = g_get_monotonic_time();
+    for (unsigned int i = 0; i < iterations; ++i) f();
+    return 1000. * (g_get_monotonic_time() - begin) / iterations;
+}
+
+int main(int argc, char ** argv) {
+    static std::string const helpOption		("help");
+    static std::string const helpOptions	( helpOption		+ ",h");
+    static std::string const iterationsOption	("iterations");
+    static std::string const iterationsOptions	( iterationsOption	+ ",n");
+
+    static unsigned int const iterationsDefault	(100000);
+
+    try {
+	std::ostringstream iterationsUsage; iterationsUsage
+	    << "parses of each payload by each parser (default: "
+	    << iterationsDefault << ").";
+
+	boost::program_options::options_description options("Options");
+	    options.add_options()
+		(helpOptions.c_str(),
+		    "Print options usage.")
+		(iterationsOptions.c_str(),
+		    boost::program_options::value<unsigned int>(),
+		    iterationsUsage.str().c_str())
+	;
+	boost::program_options::variables_map variablesMap;
+	boost::program_options::store(
+		boost::program_options::parse_command_line(argc, argv, options),
+	    variablesMap);
+	boost::program_options::notify(variablesMap);
+
+	if (variablesMap.count(helpOption)) {
+	    std::cout << options;
+	    return 0;
+	}
+
+	unsigned int iterations(variablesMap.count(iterationsOption)
+	    ? variablesMap[iterationsOption].as<unsigned int>()
+	    : iterationsDefault);
+
+	boost::shared_ptr<GUPnPLastChangeParser> parser(
+	    gupnp_last_change_parser_new(),
+	    g_object_unref);
+	CountingParser scanner;
+
+	int status = 0;
+	std::cout << std::fixed << std::setprecision(0);
+	for (size_t i = 0; i < sizeof payloads / sizeof *payloads; ++i) {
+	    Payload const & payload = payloads[i];
+	    {
+		Result expected, actual;
+		generic(parser.get(), payload, expected);
+		unsigned int fallbacks = scanner.fallbacks;
+		scanned(scanner, payload, actual);
+		if (!(expected == actual)) {
+		    std::cerr << payload.name << ": scanned " << actual
+			<< " not " << expected << std::endl;
+		    status = -1;
+		}
+		if (payload.fallback != (fallbacks != scanner.fallbacks)) {
+		    std::cerr << payload.name << ": "
+			<< (payload.fallback ? "did not fall" : "fell")
+			<< " back to the generic parser" << std::endl;
+		    status = -1;
+		}
+	    }
+	    double genericTime = measure(iterations, [&]() {
+		Result result;
+		generic(parser.get(), payload, result);
+	    });
+	    double scannerTime = measure(iterations, [&]() {
+		Result result;
+		scanned(scanner, payload, result);
+	    });
+	    std::cout << payload.name << ":"
+		<< "\tgeneric " << genericTime << " ns"
+		<< "\tscanner " << scannerTime << " ns"
+		<< std::setprecision(1)
+		<< "\t(" << genericTime / scannerTime << "x)"
+		<< std::setprecision(0) << std::endl;
+	}
+	return status;
+
+    } catch (std::exception & e) {
+	std::cerr << e.what() << std::endl;
+	return -1;
+    }
+}
@@ -1,149 +1,909 @@
 /// \file
 /// \brief Definition of r2upnpav program
 
+#include <algorithm>
+#include <atomic>
 #include <cstdarg>
+#include <fstream>
 #include <iostream>
 #include <iomanip>
+#include <list>
 #include <map>
+#include <unordered_map>
+#include <sstream>
+#include <set>
+#include <vector>
 
 // boost program options (link requires boost program_options library)
 #include <boost/program_options/options_description.hpp>
 #include <boost/program_options/variables_map.hpp>
 #include <boost/program_options/parsers.hpp>
 
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/algorithm/string/split.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/regex.hpp>
 
 #include <fcntl.h>
+#include <signal.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <linux/input.h>
+
+#include <glib-unix.h>
 
 #include <libgupnp/gupnp-control-point.h>
+#include <libgupnp/gupnp-resource-factory.h>
+#include <libgupnp/gupnp-xml-doc.h>
 #include <libgupnp-av/gupnp-av.h>
+#include <libsoup/soup.h>
+
+#include <libxml/parser.h>
 
 #include <lirc_client.h>
 
 #include <cec.h>
 
+#include "Histogram.h"
+#include "LastChangeParser.h"
+#include "LastChangeScanner.h"
+#include "Ring.h"
 #include "SystemException.h"
+#include "ZoneGroups.h"
+
+/// startupPhase logs only if verbose
+static size_t startupVerbose = 0;
+
+//**********************************************************************
+static void startupPhase(
+    char const *	phase,		///< that ended
+    gint64		elapsed = 0)	///< microseconds it took, if known
+/// \brief Log the end of a startup phase, timed from the first logged.
+//**********************************************************************
+{
+    static gint64 const started = g_get_monotonic_time();
+    if (!startupVerbose) {
+	return;
+    }
+    std::cout << "startup: " << phase << " at " << std::dec
+	<< (g_get_monotonic_time() - started) / 1000 << " ms";
+    if (elapsed) {
+	std::cout << " (in " << elapsed / 1000 << " ms)";
+    }
+    std::cout << std::endl;
+}
+
+//**********************************************************************
+template <typename T>
+static boost::shared_ptr<T> gObjectPointer(
+    T *		object)		///< reference to own (may be 0)
+/// \brief Own a (transferred) reference to a GObject.
+/// \return a pointer that releases it when the last copy is destroyed.
+//**********************************************************************
+{
+    return object
+	? boost::shared_ptr<T>(object, g_object_unref)
+	: boost::shared_ptr<T>();
+}
+
+/// Metrics singleton instance counts what happens, for export
+class Metrics {
+public:
+    /// An ActionMetrics is kept for each operation of each renderer.
+    /// Its Histograms are of microseconds.
+    struct ActionMetrics {
+	uint64_t	ended;
+	uint64_t	failed;
+	Histogram	queued;		///< from enqueue to begin
+	Histogram	roundTrip;	///< from begin to end
+	Histogram	endToEnd;	///< from input to end
+	ActionMetrics() : ended(0), failed(0) {}
+    };
+    /// An InputMetrics is kept for each input source
+    struct InputMetrics {
+	uint64_t	received;	///< events
+	uint64_t	coalesced;	///< operations batched with others
+	uint64_t	overflowed;	///< events lost
+	InputMetrics() : received(0), coalesced(0), overflowed(0) {}
+    };
+    uint64_t		renderersDiscovered;
+    uint64_t		renderersLost;
+    uint64_t		lastChangesParsed;
+    uint64_t		lastChangeErrors;
+    uint64_t		lastChangeFallbacks;	///< to the generic parser
+    uint64_t		lastChangeEchoes;	///< of our own actions
+    uint64_t		httpRequests;
+    uint64_t		httpConnections;	///< created for them
+    uint64_t		actionsElided;		///< as redundant
+    int64_t		services;		///< alive
+    int64_t		proxies;		///< of services, not finalized
+private:
+    typedef std::map<std::pair<std::string, std::string>, ActionMetrics>
+			ActionMetricsMap;
+    typedef std::map<std::string, InputMetrics>
+			InputMetricsMap;
+    static Metrics *	instance;
+    ActionMetricsMap	actionMetricsMap;
+    InputMetricsMap	inputMetricsMap;
+    Metrics()
+    :
+	renderersDiscovered(0),
+	renderersLost(0),
+	lastChangesParsed(0),
+	lastChangeErrors(0),
+	lastChangeFallbacks(0),
+	lastChangeEchoes(0),
+	httpRequests(0),
+	httpConnections(0),
+	actionsElided(0),
+	services(0),
+	proxies(0),
+	actionMetricsMap(),
+	inputMetricsMap()
+    {}
+    static void printHeader(
+	std::ostream &	o,
+	char const *	name,
+	char const *	type,
+	char const *	help)
+    {
+	o << "# HELP r2upnpav_" << name << " " << help << "\n"
+	    << "# TYPE r2upnpav_" << name << " " << type << "\n";
+    }
+    /// print a Histogram of microseconds as one of seconds
+    /// (with fixed buckets so that they may be compared across scrapes)
+    static void printHistogram(
+	std::ostream &		o,
+	char const *		name,
+	std::string const &	labels,
+	Histogram const &	histogram)
+    {
+	static uint64_t const les[] = {
+	    500, 1000, 2000, 5000, 10000, 20000, 50000,
+	    100000, 200000, 500000, 1000000, 2000000, 5000000};
+	for (size_t i = 0; i < sizeof les / sizeof *les; ++i) {
+	    o << "r2upnpav_" << name << "_bucket{" << labels
+		<< ",le=\"" << les[i] / 1e6 << "\"} "
+		<< histogram.countAtOrBelow(les[i]) << "\n";
+	}
+	o << "r2upnpav_" << name << "_bucket{" << labels << ",le=\"+Inf\"} "
+	    << histogram.getCount() << "\n";
+	o << "r2upnpav_" << name << "_sum{" << labels << "} "
+	    << histogram.getSum() / 1e6 << "\n";
+	o << "r2upnpav_" << name << "_count{" << labels << "} "
+	    << histogram.getCount() << "\n";
+    }
+public:
+    static Metrics * getInstance() {
+	return instance ? instance : (instance = new Metrics());
+    }
+    /// print a Prometheus label value, escaped
+    static void printLabel(std::ostream & o, std::string const & value) {
+	o << '"';
+	for (std::string::const_iterator it = value.begin();
+		value.end() != it; ++it) {
+	    switch (*it) {
+		case '\\':	o << "\\\\";	break;
+		case '"':	o << "\\\"";	break;
+		case '\n':	o << "\\n";	break;
+		default:	o << *it;	break;
+	    }
+	}
+	o << '"';
+    }
+    ActionMetrics & getAction(std::string const & name, char const * operation) {
+	return actionMetricsMap[std::make_pair(name, std::string(operation))];
+    }
+    InputMetrics & getInput(char const * source) {
+	return inputMetricsMap[source];
+    }
+    /// \return the source of metrics (from getInput)
+    std::string getSource(InputMetrics const & metrics) const {
+	for (InputMetricsMap::const_iterator it = inputMetricsMap.begin();
+		inputMetricsMap.end() != it; ++it) {
+	    if (&it->second == &metrics) {
+		return it->first;
+	    }
+	}
+	return std::string();
+    }
+    /// \return the ActionMetrics of all operations of all renderers
+    ActionMetrics getTotal() const {
+	ActionMetrics total;
+	for (ActionMetricsMap::const_iterator it = actionMetricsMap.begin();
+		actionMetricsMap.end() != it; ++it) {
+	    total.ended		+= it->second.ended;
+	    total.failed	+= it->second.failed;
+	    total.queued.merge(it->second.queued);
+	    total.roundTrip.merge(it->second.roundTrip);
+	    total.endToEnd.merge(it->second.endToEnd);
+	}
+	return total;
+    }
+    /// \return the percentage of HTTP requests that reused a connection
+    double getHttpReuse() const {
+	return httpRequests && httpConnections <= httpRequests
+	    ? 100. * (httpRequests - httpConnections) / httpRequests
+	    : 0;
+    }
+    void printLatencies(std::ostream & o) const {
+	o << "http: " << std::dec << httpRequests << " requests, "
+	    << httpConnections << " connections ("
+	    << getHttpReuse() << "% reused)" << std::endl;
+	o << "latencies (microseconds):" << std::endl;
+	for (ActionMetricsMap::const_iterator it = actionMetricsMap.begin();
+		actionMetricsMap.end() != it; ++it) {
+	    o << "\t" << it->first.first << "\t" << it->first.second
+		<< "\tqueued\t\t" << it->second.queued << std::endl;
+	    o << "\t" << it->first.first << "\t" << it->first.second
+		<< "\tround trip\t" << it->second.roundTrip << std::endl;
+	    o << "\t" << it->first.first << "\t" << it->first.second
+		<< "\tend to end\t" << it->second.endToEnd << std::endl;
+	}
+    }
+    /// \return our resident set size in bytes (0 if unknown)
+    static uint64_t getResidentBytes() {
+	std::ifstream statm("/proc/self/statm");
+	uint64_t size, resident = 0;
+	statm >> size >> resident;
+	return resident * sysconf(_SC_PAGESIZE);
+    }
+    /// print in the Prometheus text exposition format
+    void print(std::ostream & o) const {
+	std::ios::fmtflags flags(o.flags());
+	o << std::dec;
+	printHeader(o, "renderers_discovered_total", "counter",
+	    "Matching renderers discovered.");
+	o << "r2upnpav_renderers_discovered_total "
+	    << renderersDiscovered << "\n";
+	printHeader(o, "renderers_lost_total", "counter",
+	    "Matching renderers lost.");
+	o << "r2upnpav_renderers_lost_total " << renderersLost << "\n";
+	printHeader(o, "last_changes_parsed_total", "counter",
+	    "LastChange events parsed.");
+	o << "r2upnpav_last_changes_parsed_total "
+	    << lastChangesParsed << "\n";
+	printHeader(o, "last_change_errors_total", "counter",
+	    "LastChange events that could not be parsed.");
+	o << "r2upnpav_last_change_errors_total "
+	    << lastChangeErrors << "\n";
+	printHeader(o, "last_change_fallbacks_total", "counter",
+	    "LastChange events left for the generic parser.");
+	o << "r2upnpav_last_change_fallbacks_total "
+	    << lastChangeFallbacks << "\n";
+	printHeader(o, "last_change_echoes_total", "counter",
+	    "LastChange events dropped as echoes of our own actions.");
+	o << "r2upnpav_last_change_echoes_total "
+	    << lastChangeEchoes << "\n";
+	printHeader(o, "http_requests_total", "counter",
+	    "HTTP requests (SOAP control and others) queued.");
+	o << "r2upnpav_http_requests_total " << httpRequests << "\n";
+	printHeader(o, "http_connections_total", "counter",
+	    "HTTP connections created (the rest of requests reuse one).");
+	o << "r2upnpav_http_connections_total " << httpConnections << "\n";
+	printHeader(o, "actions_elided_total", "counter",
+	    "Renderer actions not sent as they would change nothing.");
+	o << "r2upnpav_actions_elided_total " << actionsElided << "\n";
+	printHeader(o, "input_events_total", "counter",
+	    "Input events received.");
+	for (InputMetricsMap::const_iterator it = inputMetricsMap.begin();
+		inputMetricsMap.end() != it; ++it) {
+	    o << "r2upnpav_input_events_total{source=";
+	    printLabel(o, it->first);
+	    o << "} " << it->second.received << "\n";
+	}
+	printHeader(o, "input_coalesced_total", "counter",
+	    "Input operations coalesced into others.");
+	for (InputMetricsMap::const_iterator it = inputMetricsMap.begin();
+		inputMetricsMap.end() != it; ++it) {
+	    o << "r2upnpav_input_coalesced_total{source=";
+	    printLabel(o, it->first);
+	    o << "} " << it->second.coalesced << "\n";
+	}
+	printHeader(o, "input_overflows_total", "counter",
+	    "Input events lost to overflow.");
+	for (InputMetricsMap::const_iterator it = inputMetricsMap.begin();
+		inputMetricsMap.end() != it; ++it) {
+	    o << "r2upnpav_input_overflows_total{source=";
+	    printLabel(o, it->first);
+	    o << "} " << it->second.overflowed << "\n";
+	}
+	printHeader(o, "actions_total", "counter",
+	    "Renderer actions ended.");
+	for (ActionMetricsMap::const_iterator it = actionMetricsMap.begin();
+		actionMetricsMap.end() != it; ++it) {
+	    o << "r2upnpav_actions_total{renderer=";
+	    printLabel(o, it->first.first);
+	    o << ",action=";
+	    printLabel(o, it->first.second);
+	    o << "} " << it->second.ended << "\n";
+	}
+	printHeader(o, "action_failures_total", "counter",
+	    "Renderer actions failed.");
+	for (ActionMetricsMap::const_iterator it = actionMetricsMap.begin();
+		actionMetricsMap.end() != it; ++it) {
+	    o << "r2upnpav_action_failures_total{renderer=";
+	    printLabel(o, it->first.first);
+	    o << ",action=";
+	    printLabel(o, it->first.second);
+	    o << "} " << it->second.failed << "\n";
+	}
+	struct {
+	    char const *			name;
+	    char const *			help;
+	    Histogram ActionMetrics::*		histogram;
+	} const histograms[] = {
+	    {"action_queued_seconds",
+		"Renderer action time queued.",
+		&ActionMetrics::queued},
+	    {"action_round_trip_seconds",
+		"Renderer action round trip time.",
+		&ActionMetrics::roundTrip},
+	    {"action_end_to_end_seconds",
+		"Renderer action time from input to end.",
+		&ActionMetrics::endToEnd},
+	};
+	for (size_t i = 0; i < sizeof histograms / sizeof *histograms; ++i) {
+	    printHeader(o, histograms[i].name, "histogram",
+		histograms[i].help);
+	    for (ActionMetricsMap::const_iterator it = actionMetricsMap.begin();
+		    actionMetricsMap.end() != it; ++it) {
+		std::ostringstream labels;
+		labels << "renderer=";
+		printLabel(labels, it->first.first);
+		labels << ",action=";
+		printLabel(labels, it->first.second);
+		printHistogram(o, histograms[i].name, labels.str(),
+		    it->second.*histograms[i].histogram);
+	    }
+	}
+	o.flags(flags);
+    }
+};
+Metrics * Metrics::instance = 0;
 
 /// An Output object is created to handle all UPnP AV state and output
 class Output {
 private:
-    /// LastChangeParser singleton instance parses every LastChange XML
-    class LastChangeParser {
+    /// LastChangeParser singleton instance parses every LastChange XML.
+    /// It scans for the (boolean, integer and string) variables of interest
+    /// without building a document (or allocating, but for strings)
+    /// and falls back to the generic parser for anything else.
+    class LastChangeParser : public ::LastChangeParser {
     private:
 	static LastChangeParser *	instance;
-	GUPnPLastChangeParser *		lastChangeParser;
-	LastChangeParser() : lastChangeParser(gupnp_last_change_parser_new()) {}
+	LastChangeParser() {}
+    protected:
+	void fellBack() {++Metrics::getInstance()->lastChangeFallbacks;}
     public:
 	static LastChangeParser * getInstance() {
 	    return instance ? instance : (instance = new LastChangeParser());
 	}
-	gboolean parseLastChange(
-	    guint		instance,
-	    char const *	lastChangeXml,
-	    GError **		error,
-	    ...)
-	{
-	    std::va_list args;
-	    va_start(args, error);
-	    gboolean result = gupnp_last_change_parser_parse_last_change_valist(
-		lastChangeParser, instance, lastChangeXml, error, args);
-	    va_end(args);
-	    return result;
-	}
     };
-    /// An AVTransportService is created for each matching renderer
-    class AVTransportService {
-    private:
+    /// A Service is the base of each service of a matching renderer.
+    /// Its Actions are begun asynchronously and are ended by our GMainLoop,
+    /// in whatever order their responses arrive.
+    /// So, an operation fanned out to many renderers takes as long as
+    /// the slowest of their round-trips (not the sum of them all)
+    /// and does not block the processing of other input.
+    class Service {
+    protected:
+	/// An Action is created for each action to begin on a proxy.
+	/// It is deleted when it is ended, cancelled or coalesced.
+	class Action {
+	public:
+	    Service *			service;
+	    char const *		operation;
+	    GUPnPServiceProxyAction *	action;
+	    // g_get_monotonic_time of
+	    gint64			input;	// input causing us (or 0)
+	    gint64			queued;
+	    gint64			begun;
+	    Action(char const * operation_)
+	    :
+		service(0),
+		operation(operation_),
+		action(0),
+		input(0),
+		queued(0),
+		begun(0)
+	    {}
+	    virtual ~Action() {}
+	    /// begin our operation with our in arguments
+	    virtual GUPnPServiceProxyAction * begin(
+		GUPnPServiceProxy *		proxy,
+		GUPnPServiceProxyActionCallback	callback,
+		gpointer			that) = 0;
+	    /// end our operation with our out arguments (if any)
+	    virtual void end(
+		GUPnPServiceProxy *	proxy,
+		GError **		error)
+	    {
+		gupnp_service_proxy_end_action(proxy, action, error,
+		    // out NULL terminated argument 3-tuples
+		    NULL);
+	    }
+	    /// trace our operation and its in arguments
+	    virtual void describe(std::ostream & o) const {o << operation;}
+	    /// our operation succeeded
+	    virtual void ended() {}
+	    /// our operation failed
+	    virtual void failed() {}
+	    /// merge us into an older (queued) action, if we can
+	    virtual bool merge(Action & older) {return false;}
+	    /// should we replace an older (queued) action?
+	    virtual bool supersedes(Action const & older) const {return false;}
+	    /// must newer actions not be merged into (or supersede)
+	    /// those queued before us?
+	    virtual bool isBarrier() const {return false;}
+	};
+    public:
+	/// A Queue is shared by the Services of a matching renderer.
+	/// It limits the number of their Actions in flight.
+	/// Those queued behind them are coalesced with newer ones
+	/// so that a burst of input (e.g., a held volume key) costs
+	/// a bounded number of round-trips, regardless of its rate.
+	class Queue {
+	private:
+	    typedef std::list<Action *>	Actions;
+	    size_t			concurrency;
+	    size_t			inFlight;
+	    Actions			queued;
+	    void dispatch() {
+		while (inFlight < concurrency && !queued.empty()) {
+		    Action * action = queued.front();
+		    queued.pop_front();
+		    ++inFlight;
+		    action->service->begin(action);
+		}
+	    }
+	public:
+	    Queue(size_t concurrency_)
+	    :
+		concurrency(concurrency_ ? concurrency_ : 1),
+		inFlight(0),
+		queued()
+	    {}
+	    void enqueue(Action * action) {
+		// only those after the last barrier of our service are older
+		Actions::iterator begin = queued.begin();
+		for (Actions::iterator it = queued.begin();
+			queued.end() != it; ++it) {
+		    if ((*it)->service == action->service && (*it)->isBarrier()) {
+			begin = it;
+			++begin;
+		    }
+		}
+		for (Actions::iterator it = begin; queued.end() != it; ++it) {
+		    Action * older = *it;
+		    if (older->service != action->service) continue;
+		    if (action->merge(*older)) {
+			if (action->service->verbose) {
+			    std::cout << action->service->name << ": ";
+			    older->describe(std::cout);
+			    std::cout << " merged" << std::endl;
+			}
+			delete action;
+			return;
+		    }
+		    if (action->supersedes(*older)) {
+			if (action->service->verbose) {
+			    std::cout << action->service->name << ": ";
+			    older->describe(std::cout);
+			    std::cout << " superseded" << std::endl;
+			}
+			// we are as late as the older one we supersede
+			if (older->input
+				&& (!action->input || older->input < action->input)) {
+			    action->input = older->input;
+			}
+			action->queued = older->queued;
+			delete older;
+			*it = action;
+			return;
+		    }
+		}
+		queued.push_back(action);
+		dispatch();
+	    }
+	    void ended() {
+		--inFlight;
+		dispatch();
+	    }
+	    size_t getQueued() const {return queued.size();}
+	    size_t getInFlight() const {return inFlight;}
+	    void remove(Service * service) {
+		for (Actions::iterator it = queued.begin(); queued.end() != it;) {
+		    if (service == (*it)->service) {
+			delete *it;
+			it = queued.erase(it);
+		    } else {
+			++it;
+		    }
+		}
+	    }
+	};
+	typedef boost::shared_ptr<Queue>	QueuePointer;
+    protected:
 	size_t			verbose;
 	std::string		name;
-	GUPnPServiceProxy *	proxy;
-	void operate(char const * operation) {
+	std::string		udn;
+	boost::shared_ptr<GUPnPServiceProxy>	proxy;
+	//**************************************************************
+	void subscribe(
+	    char const *			variable,
+	    GUPnPServiceProxyNotifyCallback	callback,
+	    gpointer				that)
+	/// \brief Subscribe to notifications of a (string) variable
+	/// until we are destroyed.
+	//**************************************************************
+	{
+	    if (!proxy) {
+		return;
+	    }
+	    gupnp_service_proxy_add_notify(proxy.get(),
+		variable,
+		G_TYPE_STRING,
+		callback,
+		that);
+	    gupnp_service_proxy_set_subscribed(proxy.get(), true);
+	    Notify notify = {variable, callback, that};
+	    notifies.push_back(notify);
+	}
+	void enqueue(
+	    Action *	action,
+	    gint64	input)	///< g_get_monotonic_time of input (or 0)
+	{
+	    action->service = this;
+	    action->input = input;
+	    action->queued = g_get_monotonic_time();
+	    queue->enqueue(action);
+	}
+    private:
+	typedef std::set<Action *>	Pending;
+	/// A Notify is what we subscribed to
+	struct Notify {
+	    char const *			variable;
+	    GUPnPServiceProxyNotifyCallback	callback;
+	    gpointer				that;
+	};
+	typedef std::vector<Notify>	Notifies;
+	QueuePointer			queue;
+	Pending				pending;
+	Notifies			notifies;
+	static void finalized(gpointer data, GObject * proxy) {
+	    --Metrics::getInstance()->proxies;
+	}
+	void begin(Action * action) {
 	    if (verbose) {
-		std::cout << name << ": " << operation << std::endl;
+		std::cout << name << ": ";
+		action->describe(std::cout);
+		std::cout << std::endl;
+	    }
+	    action->begun = g_get_monotonic_time();
+	    if (!proxy) {
+		// our renderer does not offer our service (e.g., AVTransport
+		// is optional) and we would never be called back,
+		// so fail now and release our slot in the queue
+		boost::shared_ptr<Action> action_(action);
+		Metrics::ActionMetrics & metrics = Metrics::getInstance()
+		    ->getAction(name, action->operation);
+		++metrics.ended;
+		++metrics.failed;
+		if (verbose) {
+		    std::cout << name << ": ";
+		    action->describe(std::cout);
+		    std::cout << " not offered" << std::endl;
+		}
+		action->failed();
+		queue->ended();
+		return;
 	    }
+	    pending.insert(action);
+	    action->action = action->begin(proxy.get(), endThat, action);
+	}
+	void end(Action * action_) {
+	    boost::shared_ptr<Action> action(action_);
+	    pending.erase(action_);
 	    GError * error = 0;
-	    gupnp_service_proxy_send_action(proxy,
-		operation, &error,
-		// in NULL terminated argument 3-tuples
-		"InstanceID",		G_TYPE_UINT,	0,
-		NULL,
-		// out NULL terminated argument 3-tuples
-		NULL);
+	    action->end(proxy.get(), &error);
+	    gint64 ended = g_get_monotonic_time();
+	    gint64 elapsed = ended - action->begun;
+	    Metrics::ActionMetrics & metrics
+		= Metrics::getInstance()->getAction(name, action->operation);
+	    ++metrics.ended;
+	    metrics.queued.record(action->begun - action->queued);
+	    metrics.roundTrip.record(elapsed);
+	    if (action->input) {
+		metrics.endToEnd.record(ended - action->input);
+	    }
 	    if (error) {
 		boost::shared_ptr<GError> errorFree(error, g_error_free);
-		std::cerr << name << ": " << operation << ": "
-		    << error->message << std::endl;
+		std::cerr << name << ": ";
+		action->describe(std::cerr);
+		std::cerr << " error: " << error->message << std::endl;
+		++metrics.failed;
+		action->failed();
+	    } else {
+		if (verbose) {
+		    std::cout << name << ": ";
+		    action->describe(std::cout);
+		    std::cout << " ended in " << std::dec
+			<< elapsed / 1000 << " ms" << std::endl;
+		}
+		action->ended();
 	    }
+	    queue->ended();
+	}
+	static void endThat(
+	    GUPnPServiceProxy *		proxy,
+	    GUPnPServiceProxyAction *	action,
+	    gpointer			that)
+	{
+	    Action * action_ = static_cast<Action *>(that);
+	    action_->service->end(action_);
 	}
     public:
-	AVTransportService(
+	Service(
 	    size_t		verbose_,
 	    char const *	name_,
-	    GUPnPDeviceInfo *	mediaRendererDeviceInfo)
+	    GUPnPDeviceInfo *	mediaRendererDeviceInfo,
+	    char const *	type,
+	    QueuePointer	queue_)
 	:
 	    verbose(verbose_),
 	    name(name_),
-	    proxy(GUPNP_SERVICE_PROXY(gupnp_device_info_get_service(
-		mediaRendererDeviceInfo,
-		"urn:schemas-upnp-org:service:AVTransport:1")))
+	    udn(gupnp_device_info_get_udn(mediaRendererDeviceInfo)),
+	    proxy(gObjectPointer(GUPNP_SERVICE_PROXY(
+		gupnp_device_info_get_service(mediaRendererDeviceInfo, type)))),
+	    queue(queue_),
+	    pending(),
+	    notifies()
 	{
+	    ++Metrics::getInstance()->services;
+	    if (proxy) {
+		// count it until it is finalized (by whoever unrefs it last)
+		++Metrics::getInstance()->proxies;
+		g_object_weak_ref(G_OBJECT(proxy.get()), finalized, 0);
+	    }
 	}
-	void pause()	{operate("Pause");}
-	void previous()	{operate("Previous");}
-	void next()	{operate("Next");}
-	void play() {
-	    if (verbose) {
-		std::cout << name << ": Play" << std::endl;
+	QueuePointer getQueue() const {return queue;}
+	std::string const & getUdn() const {return udn;}
+	/// does our renderer offer our type of service?
+	operator bool() const {return proxy.get();}
+	/// cancel all our queued and pending actions.
+	/// a derived class whose actions refer to it must do so
+	/// before it is destroyed.
+	void cancel() {
+	    queue->remove(this);
+	    // cancelled actions will not be called back
+	    for (Pending::iterator it = pending.begin();
+		    pending.end() != it; ++it) {
+		gupnp_service_proxy_cancel_action(proxy.get(), (*it)->action);
+		delete *it;
+		queue->ended();
 	    }
-	    GError * error = 0;
-	    gupnp_service_proxy_send_action(proxy,
-		"Play", &error,
-		// in NULL terminated argument 3-tuples
-		"InstanceID",		G_TYPE_UINT,	0,
-		"Speed",		G_TYPE_STRING,	"1",
-		NULL,
-		// out NULL terminated argument 3-tuples
-		NULL);
-	    if (error) {
-		boost::shared_ptr<GError> errorFree(error, g_error_free);
-		std::cerr << name << ": Play: "
-		    << error->message << std::endl;
+	    pending.clear();
+	}
+	virtual ~Service() {
+	    cancel();
+	    for (Notifies::iterator it = notifies.begin();
+		    notifies.end() != it; ++it) {
+		gupnp_service_proxy_remove_notify(proxy.get(),
+		    it->variable, it->callback, it->that);
+	    }
+	    if (!notifies.empty()) {
+		gupnp_service_proxy_set_subscribed(proxy.get(), false);
 	    }
+	    --Metrics::getInstance()->services;
 	}
     };
-    /// A RenderingControlService is created for each matching renderer
-    class RenderingControlService {
+    /// An AVTransportService is created for each matching renderer.
+    /// Its TransportState is tracked (from LastChange events)
+    /// so that Play, Pause and Stop are not sent when they would not
+    /// change it and so that PlayPause knows which to send.
+    class AVTransportService : public Service {
     private:
-	size_t			verbose;
-	std::string		name;
-	GUPnPServiceProxy *	proxy;
-	gboolean		mute;
-	guint			volume;
+	/// An InstanceAction is an operation with only an InstanceID argument
+	class InstanceAction : public Action {
+	public:
+	    InstanceAction(char const * operation) : Action(operation) {}
+	    GUPnPServiceProxyAction * begin(
+		GUPnPServiceProxy *		proxy,
+		GUPnPServiceProxyActionCallback	callback,
+		gpointer			that)
+	    {
+		return gupnp_service_proxy_begin_action(proxy,
+		    operation, callback, that,
+		    // in NULL terminated argument 3-tuples
+		    "InstanceID",		G_TYPE_UINT,	0,
+		    NULL);
+	    }
+	};
+	/// A TransportAction (Play, Pause or Stop) changes our TransportState.
+	/// It supersedes an older (queued) one.
+	class TransportAction : public InstanceAction {
+	protected:
+	    AVTransportService &	avTransportService;
+	public:
+	    TransportAction(
+		AVTransportService &	avTransportService_,
+		char const *		operation)
+	    :
+		InstanceAction(operation),
+		avTransportService(avTransportService_)
+	    {}
+	    // the TransportState we assumed may not be so
+	    void failed() {avTransportService.forgetTransportState();}
+	    bool supersedes(Action const & older) const {
+		return dynamic_cast<TransportAction const *>(&older);
+	    }
+	};
+	class PlayAction : public TransportAction {
+	public:
+	    PlayAction(AVTransportService & avTransportService)
+	    : TransportAction(avTransportService, "Play") {}
+	    GUPnPServiceProxyAction * begin(
+		GUPnPServiceProxy *		proxy,
+		GUPnPServiceProxyActionCallback	callback,
+		gpointer			that)
+	    {
+		return gupnp_service_proxy_begin_action(proxy,
+		    operation, callback, that,
+		    // in NULL terminated argument 3-tuples
+		    "InstanceID",		G_TYPE_UINT,	0,
+		    "Speed",		G_TYPE_STRING,	"1",
+		    NULL);
+	    }
+	};
+	/// A SeekAction seeks to a time in the current track.
+	/// It supersedes an older (queued) one.
+	class SeekAction : public Action {
+	private:
+	    std::string		target;	///< H+:MM:SS
+	public:
+	    SeekAction(std::string const & target_)
+	    :
+		Action("Seek"),
+		target(target_)
+	    {}
+	    GUPnPServiceProxyAction * begin(
+		GUPnPServiceProxy *		proxy,
+		GUPnPServiceProxyActionCallback	callback,
+		gpointer			that)
+	    {
+		return gupnp_service_proxy_begin_action(proxy,
+		    operation, callback, that,
+		    // in NULL terminated argument 3-tuples
+		    "InstanceID",		G_TYPE_UINT,	0,
+		    "Unit",		G_TYPE_STRING,	"REL_TIME",
+		    "Target",		G_TYPE_STRING,	target.c_str(),
+		    NULL);
+	    }
+	    void describe(std::ostream & o) const {
+		o << operation << " " << target;
+	    }
+	    bool supersedes(Action const & older) const {
+		return dynamic_cast<SeekAction const *>(&older);
+	    }
+	};
+	class GetTransportInfoAction : public InstanceAction {
+	private:
+	    AVTransportService &	avTransportService;
+	    char *			currentTransportState;
+	    char *			currentTransportStatus;
+	    char *			currentSpeed;
+	public:
+	    GetTransportInfoAction(AVTransportService & avTransportService_)
+	    :
+		InstanceAction("GetTransportInfo"),
+		avTransportService(avTransportService_),
+		currentTransportState(0),
+		currentTransportStatus(0),
+		currentSpeed(0)
+	    {}
+	    ~GetTransportInfoAction() {
+		g_free(currentTransportState);
+		g_free(currentTransportStatus);
+		g_free(currentSpeed);
+	    }
+	    void end(
+		GUPnPServiceProxy *	proxy,
+		GError **		error)
+	    {
+		gupnp_service_proxy_end_action(proxy, action, error,
+		    // out NULL terminated argument 3-tuples
+		    "CurrentTransportState",	G_TYPE_STRING,
+			&currentTransportState,
+		    "CurrentTransportStatus",	G_TYPE_STRING,
+			&currentTransportStatus,
+		    "CurrentSpeed",		G_TYPE_STRING,	&currentSpeed,
+		    NULL);
+	    }
+	    void ended() {
+		if (currentTransportState) {
+		    avTransportService.knowTransportState(
+			currentTransportState);
+		}
+	    }
+	};
+	std::string		transportState;
+	bool			transportStateKnown;
+	void knowTransportState(char const * transportState_) {
+	    transportState = transportState_;
+	    if (!transportStateKnown) {
+		transportStateKnown = true;
+		if (verbose) {
+		    std::cout << name << ": TransportState known "
+			<< transportState << std::endl;
+		}
+	    }
+	}
+	void forgetTransportState() {
+	    transportStateKnown = false;
+	}
+	bool isPlaying() const {
+	    return "PLAYING" == transportState
+		|| "TRANSITIONING" == transportState;
+	}
+	bool isStopped() const {
+	    return "STOPPED" == transportState
+		|| "NO_MEDIA_PRESENT" == transportState;
+	}
+	/// enqueue a TransportAction unless we know it would change nothing.
+	/// assume it will succeed so that another like it is elided
+	/// (and a toggle toggles back).
+	void transport(
+	    TransportAction *	action,
+	    bool		redundant,
+	    char const *	transportState_,
+	    gint64		input)
+	{
+	    if (transportStateKnown && redundant) {
+		++Metrics::getInstance()->actionsElided;
+		if (verbose) {
+		    std::cout << name << ": " << action->operation
+			<< " elided (" << transportState << ")" << std::endl;
+		}
+		delete action;
+		return;
+	    }
+	    transportState = transportState_;
+	    enqueue(action, input);
+	}
 	void onLastChange(
 	    char const *	notification,
 	    GValue *		lastChange)
 	{
 	    GError *		error = 0;
 	    char const *	lastChangeXml = g_value_get_string(lastChange);
-	    // look for val's of instance 0 variables of interest,
-	    // parse their formatted values and remember them.
-	    // if any of these variables were not just (last) changed
-	    // (e.g, mute won't change volume and vice-versa),
-	    // it will not be reported and the parse will silently succeed
-	    // without modifying the remembered values.
+	    // TransportState is reported only if it was (last) changed
+	    char *		lastTransportState = 0;
 	    if (LastChangeParser::getInstance()->parseLastChange(
 		    0,			// instance id of interest
 		    lastChangeXml,	// XML to parse
 		    &error,		// error returned
-		    "Mute",	G_TYPE_BOOLEAN,	&mute,
-		    "Volume",	G_TYPE_UINT,	&volume,
+		    "TransportState",	G_TYPE_STRING,	&lastTransportState,
 		    NULL)) {
-		if (verbose) {
-		    std::cout << name << ": LastChange "
-			<< mute << " " << std::dec << volume << std::endl;
+		++Metrics::getInstance()->lastChangesParsed;
+		if (lastTransportState) {
+		    knowTransportState(lastTransportState);
+		    g_free(lastTransportState);
+		    if (verbose) {
+			std::cout << name << ": LastChange "
+			    << transportState << std::endl;
+		    }
 		}
 	    } else if (error) {
+		++Metrics::getInstance()->lastChangeErrors;
 		boost::shared_ptr<GError> errorFree(error, g_error_free);
 		std::cerr << name << ": LastChange error: "
 		    << error->message << std::endl;
@@ -155,142 +915,1269 @@ private:
 	    GValue *		lastChange,
 	    gpointer		that)
 	{
-	    static_cast<RenderingControlService *>(that)
+	    static_cast<AVTransportService *>(that)
 		->onLastChange(name, lastChange);
 	}
     public:
-	RenderingControlService(
-	    size_t		verbose_,
-	    char const *	name_,
-	    GUPnPDeviceInfo *	mediaRendererDeviceInfo)
+	AVTransportService(
+	    size_t		verbose,
+	    char const *	name,
+	    GUPnPDeviceInfo *	mediaRendererDeviceInfo,
+	    QueuePointer	queue)
 	:
-	    verbose(verbose_),
-	    name(name_),
-	    proxy(GUPNP_SERVICE_PROXY(gupnp_device_info_get_service(
-		mediaRendererDeviceInfo,
-		"urn:schemas-upnp-org:service:RenderingControl:1"))),
-	    mute(FALSE),
-	    volume(0)
+	    Service(verbose, name, mediaRendererDeviceInfo,
+		"urn:schemas-upnp-org:service:AVTransport:1", queue),
+	    transportState(),
+	    transportStateKnown(false)
 	{
-	    gupnp_service_proxy_add_notify(proxy,
-		"LastChange",
-		G_TYPE_STRING,
-		onLastChangeThat,
-		this);
-	    gupnp_service_proxy_set_subscribed(proxy, true);
-	    GError * error;
-	    // get the latest mute and volume settings.
-	    // we may get (redundant) LastChange notification while we
-	    // do this but we want to make sure we got it.
-	    error = 0;
-	    gupnp_service_proxy_send_action(proxy,
-		"GetMute", &error,
-		// in NULL terminated argument 3-tuples
-		"InstanceID",		G_TYPE_UINT,	0,
-		"Channel",		G_TYPE_STRING,	"Master",
-		NULL,
-		// out NULL terminated argument 3-tuples
-		"CurrentMute",		G_TYPE_BOOLEAN,	&mute,
-		NULL);
-	    if (error) {
-		boost::shared_ptr<GError> errorFree(error, g_error_free);
-		std::cerr << name << ": GetMute error: "
-		    << error->message << std::endl;
-	    } else {
-		if (verbose) {
-		    std::cout << name << ": GetMute: "
-			<< static_cast<bool>(mute) << std::endl;
+	    subscribe("LastChange", onLastChangeThat, this);
+	    // get the latest TransportState in the background
+	    enqueue(new GetTransportInfoAction(*this), 0);
+	}
+	~AVTransportService() {
+	    // our TransportActions refer to us
+	    cancel();
+	}
+	void pause(gint64 input) {
+	    transport(new TransportAction(*this, "Pause"),
+		!isPlaying(), "PAUSED_PLAYBACK", input);
+	}
+	void previous(gint64 input) {
+	    enqueue(new InstanceAction("Previous"), input);
+	}
+	void next(gint64 input) {
+	    enqueue(new InstanceAction("Next"), input);
+	}
+	void play(gint64 input) {
+	    transport(new PlayAction(*this), isPlaying(), "PLAYING", input);
+	}
+	/// pause if we know we are playing; otherwise, play
+	void togglePlay(gint64 input) {
+	    transportStateKnown && isPlaying() ? pause(input) : play(input);
+	}
+	void stop(gint64 input) {
+	    transport(new TransportAction(*this, "Stop"),
+		isStopped(), "STOPPED", input);
+	}
+	void seek(std::string const & target, gint64 input) {
+	    enqueue(new SeekAction(target), input);
+	}
+    };
+    /// A RenderingControlService is created for each matching renderer.
+    /// Its mute and volume state is fetched in the background
+    /// (and then tracked by LastChange events).
+    /// Until mute is known, a toggleMute is deferred until it is
+    /// and a setRelativeVolume unmutes unconditionally.
+    class RenderingControlService : public Service {
+    private:
+	enum {MaxVolume = 100};	///< of Master channel
+	/// A ChannelAction is an operation with InstanceID and Channel arguments
+	class ChannelAction : public Action {
+	protected:
+	    RenderingControlService &	renderingControlService;
+	public:
+	    ChannelAction(
+		RenderingControlService &	renderingControlService_,
+		char const *			operation)
+	    :
+		Action(operation),
+		renderingControlService(renderingControlService_)
+	    {}
+	    GUPnPServiceProxyAction * begin(
+		GUPnPServiceProxy *		proxy,
+		GUPnPServiceProxyActionCallback	callback,
+		gpointer			that)
+	    {
+		return gupnp_service_proxy_begin_action(proxy,
+		    operation, callback, that,
+		    // in NULL terminated argument 3-tuples
+		    "InstanceID",		G_TYPE_UINT,	0,
+		    "Channel",		G_TYPE_STRING,	"Master",
+		    NULL);
+	    }
+	};
+	class GetMuteAction : public ChannelAction {
+	private:
+	    gboolean			currentMute;
+	public:
+	    GetMuteAction(RenderingControlService & renderingControlService)
+	    :
+		ChannelAction(renderingControlService, "GetMute"),
+		currentMute(FALSE)
+	    {}
+	    void end(
+		GUPnPServiceProxy *	proxy,
+		GError **		error)
+	    {
+		gupnp_service_proxy_end_action(proxy, action, error,
+		    // out NULL terminated argument 3-tuples
+		    "CurrentMute",		G_TYPE_BOOLEAN,	&currentMute,
+		    NULL);
+	    }
+	    void ended() {renderingControlService.knowMute(currentMute);}
+	    // assume the common case so that a deferred toggle is not lost
+	    void failed() {renderingControlService.knowMute(FALSE);}
+	};
+	class GetVolumeAction : public ChannelAction {
+	private:
+	    guint			currentVolume;
+	public:
+	    GetVolumeAction(RenderingControlService & renderingControlService)
+	    :
+		ChannelAction(renderingControlService, "GetVolume"),
+		currentVolume(0)
+	    {}
+	    void end(
+		GUPnPServiceProxy *	proxy,
+		GError **		error)
+	    {
+		gupnp_service_proxy_end_action(proxy, action, error,
+		    // out NULL terminated argument 3-tuples
+		    "CurrentVolume",	G_TYPE_UINT,	&currentVolume,
+		    NULL);
+	    }
+	    void ended() {renderingControlService.knowVolume(currentVolume);}
+	};
+	class SetMuteAction : public Action {
+	private:
+	    RenderingControlService &	renderingControlService;
+	    gboolean			desiredMute;
+	public:
+	    SetMuteAction(
+		RenderingControlService &	renderingControlService_,
+		gboolean			desiredMute_)
+	    :
+		Action("SetMute"),
+		renderingControlService(renderingControlService_),
+		desiredMute(desiredMute_)
+	    {}
+	    GUPnPServiceProxyAction * begin(
+		GUPnPServiceProxy *		proxy,
+		GUPnPServiceProxyActionCallback	callback,
+		gpointer			that)
+	    {
+		renderingControlService.expectEcho(true, desiredMute);
+		return gupnp_service_proxy_begin_action(proxy,
+		    operation, callback, that,
+		    // in NULL terminated argument 3-tuples
+		    "InstanceID",		G_TYPE_UINT,	0,
+		    "Channel",		G_TYPE_STRING,	"Master",
+		    "DesiredMute",		G_TYPE_BOOLEAN,	desiredMute,
+		    NULL);
+	    }
+	    void describe(std::ostream & o) const {
+		o << operation << " " << static_cast<bool>(desiredMute);
+	    }
+	    void ended() {
+		// an unknown mute is now known;
+		// otherwise, we already assumed it would be so.
+		if (!renderingControlService.muteKnown) {
+		    renderingControlService.knowMute(desiredMute);
 		}
 	    }
-	    error = 0;
-	    gupnp_service_proxy_send_action(proxy,
-		"GetVolume", &error,
-		// in NULL terminated argument 3-tuples
-		"InstanceID",		G_TYPE_UINT,	0,
-		"Channel",		G_TYPE_STRING,	"Master",
-		NULL,
-		// out NULL terminated argument 3-tuples
-		"CurrentVolume",	G_TYPE_UINT,	&volume,
-		NULL);
-	    if (error) {
-		boost::shared_ptr<GError> errorFree(error, g_error_free);
-		std::cerr << name << ": GetVolume error: "
-		    << error->message << std::endl;
-	    } else {
-		if (verbose) {
-		    std::cout << name << ": GetVolume: "
-			<< std::dec << volume << std::endl;
+	    void failed() {
+		// undo what we assumed so that another toggle is not inverted
+		if (renderingControlService.muteKnown) {
+		    renderingControlService.mute = !desiredMute;
 		}
 	    }
-	}
-	void toggleMute() {
-	    if (verbose) {
-		std::cout << name << ": SetMute "
-		    << static_cast<bool>(!mute) << std::endl;
+	    bool supersedes(Action const & older) const {
+		return dynamic_cast<SetMuteAction const *>(&older);
 	    }
-	    GError * error = 0;
-	    gupnp_service_proxy_send_action(proxy,
-		"SetMute", &error,
-		// in NULL terminated argument 3-tuples
-		"InstanceID",		G_TYPE_UINT,	0,
-		"Channel",		G_TYPE_STRING,	"Master",
-		"DesiredMute",		G_TYPE_BOOLEAN,	!mute,
-		NULL,
-		// out NULL terminated argument 3-tuples
-		NULL);
-	    if (error) {
-		boost::shared_ptr<GError> errorFree(error, g_error_free);
-		std::cerr << name << ": SetMute error: "
-		    << error->message << std::endl;
-	    } else {
-		mute = !mute;
+	};
+	class SetRelativeVolumeAction : public Action {
+	private:
+	    RenderingControlService &	renderingControlService;
+	    gint			adjustment;
+	    guint			newVolume;
+	    guint			predicted;	///< echo (or G_MAXUINT)
+	    bool			inFlight;
+	public:
+	    SetRelativeVolumeAction(
+		RenderingControlService &	renderingControlService_,
+		gint				adjustment_)
+	    :
+		Action("SetRelativeVolume"),
+		renderingControlService(renderingControlService_),
+		adjustment(adjustment_),
+		newVolume(0),
+		predicted(G_MAXUINT),
+		inFlight(false)
+	    {}
+	    ~SetRelativeVolumeAction() {
+		if (inFlight) --renderingControlService.volumesInFlight;
 	    }
-	}
-	void setRelativeVolume(gint adjustment) {
-	    if (mute) {
-		toggleMute();
+	    GUPnPServiceProxyAction * begin(
+		GUPnPServiceProxy *		proxy,
+		GUPnPServiceProxyActionCallback	callback,
+		gpointer			that)
+	    {
+		// its echo may arrive before we know its NewVolume.
+		// predict it only from a volume no other action is changing.
+		if (renderingControlService.volumeKnown
+			&& !renderingControlService.volumesInFlight) {
+		    predicted = std::max(0, std::min<gint>(MaxVolume,
+			adjustment + static_cast<gint>(
+			    renderingControlService.volume)));
+		    renderingControlService.expectEcho(false, predicted);
+		}
+		inFlight = true;
+		++renderingControlService.volumesInFlight;
+		return gupnp_service_proxy_begin_action(proxy,
+		    operation, callback, that,
+		    // in NULL terminated argument 3-tuples
+		    "InstanceID",		G_TYPE_UINT,	0,
+		    "Channel",		G_TYPE_STRING,	"Master",
+		    "Adjustment",		G_TYPE_INT,	adjustment,
+		    NULL);
 	    }
-	    if (verbose) {
-		std::cout << name << ": SetRelativeVolume "
-		    << std::dec << adjustment << std::endl;
+	    void end(
+		GUPnPServiceProxy *	proxy,
+		GError **		error)
+	    {
+		gupnp_service_proxy_end_action(proxy, action, error,
+		    // out NULL terminated argument 3-tuples
+		    "NewVolume",		G_TYPE_UINT,	&newVolume,
+		    NULL);
 	    }
-	    GError * error = 0;
-	    gupnp_service_proxy_send_action(proxy,
-		"SetRelativeVolume", &error,
-		// in NULL terminated argument 3-tuples
-		"InstanceID",		G_TYPE_UINT,	0,
-		"Channel",		G_TYPE_STRING,	"Master",
-		"Adjustment",		G_TYPE_INT,	adjustment,
-		NULL,
-		// out NULL terminated argument 3-tuples
-		"NewVolume",		G_TYPE_UINT,	&volume,
-		NULL);
-	    if (error) {
-		boost::shared_ptr<GError> errorFree(error, g_error_free);
-		std::cerr << name << ": SetVolume error: "
-		    << error->message << std::endl;
-	    } else {
-		if (verbose) {
-		    std::cout << name << ": SetVolume "
-			<< std::dec << volume << std::endl;
+	    void describe(std::ostream & o) const {
+		o << operation << " " << std::dec << adjustment;
+	    }
+	    bool merge(Action & older) {
+		SetRelativeVolumeAction * that
+		    = dynamic_cast<SetRelativeVolumeAction *>(&older);
+		if (that) {
+		    that->adjustment += adjustment;
 		}
+		return that;
 	    }
-	}
-    };
-
-    typedef boost::shared_ptr<AVTransportService>
-					AVTransportServicePointer;
-    typedef std::map<std::string, AVTransportServicePointer>
-					AVTransportServiceMap;
+	    void ended() {
+		renderingControlService.knowVolume(newVolume);
+		// (unless expected already, as its echo may have consumed it)
+		if (predicted != newVolume) {
+		    renderingControlService.expectEcho(false, newVolume);
+		}
+	    }
+	};
+	/// A SetVolumeAction sets an absolute volume.
+	/// As this is idempotent, the last one queued wins
+	/// and a failed one may be retried.
+	class SetVolumeAction : public ChannelAction {
+	private:
+	    guint			desiredVolume;
+	    size_t			retries;
+	    bool			inFlight;
+	public:
+	    SetVolumeAction(
+		RenderingControlService &	renderingControlService,
+		guint				desiredVolume_,
+		size_t				retries_)
+	    :
+		ChannelAction(renderingControlService, "SetVolume"),
+		desiredVolume(desiredVolume_),
+		retries(retries_),
+		inFlight(false)
+	    {
+		++renderingControlService.volumeTargets;
+	    }
+	    ~SetVolumeAction() {
+		--renderingControlService.volumeTargets;
+		if (inFlight) --renderingControlService.volumesInFlight;
+	    }
+	    GUPnPServiceProxyAction * begin(
+		GUPnPServiceProxy *		proxy,
+		GUPnPServiceProxyActionCallback	callback,
+		gpointer			that)
+	    {
+		renderingControlService.expectEcho(false, desiredVolume);
+		inFlight = true;
+		++renderingControlService.volumesInFlight;
+		return gupnp_service_proxy_begin_action(proxy,
+		    operation, callback, that,
+		    // in NULL terminated argument 3-tuples
+		    "InstanceID",		G_TYPE_UINT,	0,
+		    "Channel",		G_TYPE_STRING,	"Master",
+		    "DesiredVolume",	G_TYPE_UINT,	desiredVolume,
+		    NULL);
+	    }
+	    void describe(std::ostream & o) const {
+		o << operation << " " << std::dec << desiredVolume;
+	    }
+	    void ended() {
+		renderingControlService.knowVolume(desiredVolume);
+	    }
+	    void failed() {
+		// retry unless we have been overtaken by another
+		if (retries && 1 == renderingControlService.volumeTargets) {
+		    renderingControlService.enqueue(new SetVolumeAction(
+			renderingControlService, desiredVolume, retries - 1),
+			input);
+		}
+	    }
+	    bool supersedes(Action const & older) const {
+		return dynamic_cast<SetVolumeAction const *>(&older);
+	    }
+	};
+	bool			absolute;
+	gboolean		mute;
+	bool			muteKnown;
+	bool			toggleMuteDeferred;
+	gint64			toggleMuteDeferredInput;
+	guint			volume;
+	bool			volumeKnown;
+	guint			volumeTarget;	// of last SetVolumeAction
+	size_t			volumeTargets;	// SetVolumeActions outstanding
+	size_t			volumesInFlight;	// volume actions begun
+	/// An Echo is a LastChange value expected from one of our actions
+	struct Echo {
+	    bool		mute;	///< otherwise, volume
+	    guint		value;
+	    gint64		expires;
+	};
+	enum {
+	    Echoes		= 8,
+	    EchoLifetime	= 2 * G_USEC_PER_SEC
+	};
+	Echo			echoes[Echoes];	// oldest first
+	size_t			echoCount;
+	void expectEcho(bool mute_, guint value) {
+	    if (Echoes == echoCount) {
+		std::copy(echoes + 1, echoes + echoCount, echoes);
+		--echoCount;
+	    }
+	    Echo echo = {mute_, value, g_get_monotonic_time() + EchoLifetime};
+	    echoes[echoCount++] = echo;
+	}
+	//**************************************************************
+	bool isEcho(
+	    char const *	lastChangeXml,
+	    gboolean &		lastMute,	///< if last expected (out)
+	    guint &		lastVolume)	///< if last expected (out)
+	/// \brief Recognize a LastChange that reports only the values
+	/// we expect from our own (recent) actions, without parsing it
+	/// (or allocating) and forget those expected up to them.
+	/// Those that no later action is expected to change are returned.
+	/// \return true if lastChangeXml is such an echo.
+	//**************************************************************
+	{
+	    gint64 now = g_get_monotonic_time();
+	    size_t expired = 0;
+	    while (expired < echoCount && echoes[expired].expires < now) {
+		++expired;
+	    }
+	    std::copy(echoes + expired, echoes + echoCount, echoes);
+	    echoCount -= expired;
+	    if (!echoCount) {
+		return false;
+	    }
+	    static char const * const names[] = {"Mute", "Volume"};
+	    LastChangeScanner::Value values[2];
+	    LastChangeScanner scanner;
+	    if (LastChangeScanner::Found
+		    != scanner.scan(lastChangeXml, 0, names, 2, values)
+		    || !(values[0].begin || values[1].begin)) {
+		return false;
+	    }
+	    // through which (for mute and volume) echoes are echoed
+	    size_t through[2] = {0, 0};
+	    guint echoed[2] = {0, 0};
+	    for (size_t k = 0; k < 2; ++k) {
+		if (!values[k].begin) continue;
+		guint value;
+		bool boolean;
+		if (0 == k
+			? !LastChangeScanner::toBoolean(values[k], boolean)
+			: !LastChangeScanner::toUnsigned(values[k], value)) {
+		    return false;
+		}
+		if (0 == k) value = boolean;
+		for (size_t i = echoCount; i--;) {
+		    if ((0 == k) == echoes[i].mute && value == echoes[i].value) {
+			through[k] = i + 1;
+			break;
+		    }
+		}
+		if (!through[k]) {
+		    return false;
+		}
+		echoed[k] = value;
+	    }
+	    // still expected (for mute and volume)
+	    bool expected[2] = {false, false};
+	    size_t kept = 0;
+	    for (size_t i = 0; i < echoCount; ++i) {
+		size_t k = echoes[i].mute ? 0 : 1;
+		if (i >= through[k]) {
+		    expected[k] = true;
+		    echoes[kept++] = echoes[i];
+		}
+	    }
+	    echoCount = kept;
+	    if (through[0] && !expected[0]) lastMute = echoed[0];
+	    if (through[1] && !expected[1]) lastVolume = echoed[1];
+	    return true;
+	}
+	void knowMute(gboolean mute_) {
+	    mute = mute_;
+	    if (!muteKnown) {
+		muteKnown = true;
+		if (verbose) {
+		    std::cout << name << ": mute known "
+			<< static_cast<bool>(mute) << std::endl;
+		}
+		if (toggleMuteDeferred) {
+		    toggleMuteDeferred = false;
+		    toggleMute(toggleMuteDeferredInput);
+		}
+	    }
+	}
+	void knowVolume(guint volume_) {
+	    volume = volume_;
+	    if (!volumeKnown) {
+		volumeKnown = true;
+		if (verbose) {
+		    std::cout << name << ": volume known "
+			<< std::dec << volume << std::endl;
+		}
+	    }
+	}
+	void onLastChange(
+	    char const *	notification,
+	    GValue *		lastChange)
+	{
+	    char const *	lastChangeXml = g_value_get_string(lastChange);
+	    // look for val's of instance 0 variables of interest,
+	    // parse their formatted values and remember them.
+	    // if any of these variables were not just (last) changed
+	    // (e.g, mute won't change volume and vice-versa),
+	    // it will not be reported and the parse will silently succeed
+	    // without modifying these (impossible) values.
+	    gboolean		lastMute	= -1;
+	    guint		lastVolume	= G_MAXUINT;
+	    // what we already assumed (or will know) from our own actions
+	    // need not be parsed or traced and is known only if it is
+	    // the last we expect (an earlier one may arrive out of order).
+	    if (isEcho(lastChangeXml, lastMute, lastVolume)) {
+		++Metrics::getInstance()->lastChangeEchoes;
+		if (-1 != lastMute) {
+		    knowMute(lastMute);
+		}
+		if (G_MAXUINT != lastVolume) {
+		    knowVolume(lastVolume);
+		}
+		return;
+	    }
+	    GError *		error = 0;
+	    if (LastChangeParser::getInstance()->parseLastChange(
+		    0,			// instance id of interest
+		    lastChangeXml,	// XML to parse
+		    &error,		// error returned
+		    "Mute",	G_TYPE_BOOLEAN,	&lastMute,
+		    "Volume",	G_TYPE_UINT,	&lastVolume,
+		    NULL)) {
+		++Metrics::getInstance()->lastChangesParsed;
+		if (-1 != lastMute) {
+		    knowMute(lastMute);
+		}
+		if (G_MAXUINT != lastVolume) {
+		    knowVolume(lastVolume);
+		}
+		if (verbose) {
+		    std::cout << name << ": LastChange "
+			<< mute << " " << std::dec << volume << std::endl;
+		}
+	    } else if (error) {
+		++Metrics::getInstance()->lastChangeErrors;
+		boost::shared_ptr<GError> errorFree(error, g_error_free);
+		std::cerr << name << ": LastChange error: "
+		    << error->message << std::endl;
+	    }
+	}
+	static void onLastChangeThat(
+	    GUPnPServiceProxy *	proxy,
+	    char const *	name,
+	    GValue *		lastChange,
+	    gpointer		that)
+	{
+	    static_cast<RenderingControlService *>(that)
+		->onLastChange(name, lastChange);
+	}
+    public:
+	RenderingControlService(
+	    size_t		verbose,
+	    char const *	name,
+	    GUPnPDeviceInfo *	mediaRendererDeviceInfo,
+	    QueuePointer	queue,
+	    bool		absolute_)
+	:
+	    Service(verbose, name, mediaRendererDeviceInfo,
+		"urn:schemas-upnp-org:service:RenderingControl:1", queue),
+	    absolute(absolute_),
+	    mute(FALSE),
+	    muteKnown(false),
+	    toggleMuteDeferred(false),
+	    toggleMuteDeferredInput(0),
+	    volume(0),
+	    volumeKnown(false),
+	    volumeTarget(0),
+	    volumeTargets(0),
+	    volumesInFlight(0),
+	    echoes(),
+	    echoCount(0)
+	{
+	    subscribe("LastChange", onLastChangeThat, this);
+	    // get the latest mute and volume settings in the background.
+	    // we may get (redundant) LastChange notification while we
+	    // do this but we want to make sure we got it.
+	    enqueue(new GetMuteAction(*this), 0);
+	    enqueue(new GetVolumeAction(*this), 0);
+	}
+	void toggleMute(gint64 input) {
+	    if (muteKnown) {
+		// assume the toggle will succeed so that another toggles it back
+		mute = !mute;
+		enqueue(new SetMuteAction(*this, mute), input);
+	    } else {
+		toggleMuteDeferred = !toggleMuteDeferred;
+		toggleMuteDeferredInput = input;
+		if (verbose) {
+		    std::cout << name << ": SetMute deferred "
+			<< toggleMuteDeferred << std::endl;
+		}
+	    }
+	}
+	void unmute(gint64 input) {
+	    if (!muteKnown) {
+		// overrides a deferred toggle
+		toggleMuteDeferred = false;
+		enqueue(new SetMuteAction(*this, FALSE), input);
+	    } else if (mute) {
+		toggleMute(input);
+	    }
+	}
+	void setRelativeVolume(gint adjustment, gint64 input) {
+	    // adjusting volume implies unmute.
+	    // unmute and adjust are begun together,
+	    // without waiting for one to end before the other.
+	    unmute(input);
+	    if (absolute && volumeKnown) {
+		// target relative to the last target, if still outstanding,
+		// otherwise, relative to the volume we know
+		gint target = adjustment
+		    + static_cast<gint>(volumeTargets ? volumeTarget : volume);
+		volumeTarget = std::max(0, std::min<gint>(MaxVolume, target));
+		enqueue(new SetVolumeAction(*this, volumeTarget, 1), input);
+	    } else {
+		enqueue(new SetRelativeVolumeAction(*this, adjustment), input);
+	    }
+	}
+	void setVolume(guint desiredVolume, gint64 input) {
+	    // setting volume implies unmute
+	    unmute(input);
+	    volumeTarget = std::min<guint>(MaxVolume, desiredVolume);
+	    enqueue(new SetVolumeAction(*this, volumeTarget, 1), input);
+	}
+	~RenderingControlService() {
+	    // our SetVolumeActions refer to us
+	    cancel();
+	}
+    };
+    /// A GroupRenderingControlService is created for each matching renderer
+    /// that offers one (e.g., Sonos).
+    /// When it coordinates a group, it adjusts the volume of the group
+    /// (its members in proportion to each other) with one action.
+    class GroupRenderingControlService : public Service {
+    private:
+	/// A SnapshotGroupVolumeAction is a barrier so that no adjustment
+	/// after it is merged into one before it (and so made without it).
+	class SnapshotGroupVolumeAction : public Action {
+	private:
+	    GroupRenderingControlService &	groupRenderingControlService;
+	public:
+	    SnapshotGroupVolumeAction(
+		GroupRenderingControlService &	groupRenderingControlService_)
+	    :
+		Action("SnapshotGroupVolume"),
+		groupRenderingControlService(groupRenderingControlService_)
+	    {}
+	    GUPnPServiceProxyAction * begin(
+		GUPnPServiceProxy *		proxy,
+		GUPnPServiceProxyActionCallback	callback,
+		gpointer			that)
+	    {
+		return gupnp_service_proxy_begin_action(proxy,
+		    operation, callback, that,
+		    // in NULL terminated argument 3-tuples
+		    "InstanceID",		G_TYPE_UINT,	0,
+		    NULL);
+	    }
+	    void ended() {
+		// (unless the group changed since we were enqueued)
+		if (Taking == groupRenderingControlService.snapshot) {
+		    groupRenderingControlService.snapshot = Taken;
+		}
+	    }
+	    void failed() {
+		// take another before the next adjustment
+		if (Taking == groupRenderingControlService.snapshot) {
+		    groupRenderingControlService.snapshot = Stale;
+		}
+	    }
+	    bool isBarrier() const {return true;}
+	};
+	class SetRelativeGroupVolumeAction : public Action {
+	private:
+	    gint			adjustment;
+	    guint			newVolume;
+	public:
+	    SetRelativeGroupVolumeAction(gint adjustment_)
+	    :
+		Action("SetRelativeGroupVolume"),
+		adjustment(adjustment_),
+		newVolume(0)
+	    {}
+	    GUPnPServiceProxyAction * begin(
+		GUPnPServiceProxy *		proxy,
+		GUPnPServiceProxyActionCallback	callback,
+		gpointer			that)
+	    {
+		return gupnp_service_proxy_begin_action(proxy,
+		    operation, callback, that,
+		    // in NULL terminated argument 3-tuples
+		    "InstanceID",		G_TYPE_UINT,	0,
+		    "Adjustment",		G_TYPE_INT,	adjustment,
+		    NULL);
+	    }
+	    void end(
+		GUPnPServiceProxy *	proxy,
+		GError **		error)
+	    {
+		gupnp_service_proxy_end_action(proxy, action, error,
+		    // out NULL terminated argument 3-tuples
+		    "NewVolume",		G_TYPE_UINT,	&newVolume,
+		    NULL);
+	    }
+	    void describe(std::ostream & o) const {
+		o << operation << " " << std::dec << adjustment;
+	    }
+	    bool merge(Action & older) {
+		SetRelativeGroupVolumeAction * that
+		    = dynamic_cast<SetRelativeGroupVolumeAction *>(&older);
+		if (that) {
+		    that->adjustment += adjustment;
+		}
+		return that;
+	    }
+	};
+	/// of member volumes, from which relative ones are maintained
+	enum Snapshot {Stale, Taking, Taken};
+	Snapshot		snapshot;
+    public:
+	GroupRenderingControlService(
+	    size_t		verbose,
+	    char const *	name,
+	    GUPnPDeviceInfo *	mediaRendererDeviceInfo,
+	    QueuePointer	queue)
+	:
+	    Service(verbose, name, mediaRendererDeviceInfo,
+		"urn:schemas-upnp-org:service:GroupRenderingControl:1", queue),
+	    snapshot(Stale)
+	{
+	}
+	/// the group has changed. our snapshot of member volumes is stale.
+	void regroup() {snapshot = Stale;}
+	void setRelativeGroupVolume(gint adjustment, gint64 input) {
+	    // relative member volumes are maintained from a snapshot
+	    if (Stale == snapshot) {
+		snapshot = Taking;
+		enqueue(new SnapshotGroupVolumeAction(*this), input);
+	    }
+	    enqueue(new SetRelativeGroupVolumeAction(adjustment), input);
+	}
+    };
+    /// A ZoneGroupTopology is created for each Sonos ZonePlayer
+    /// when operations are to be grouped.
+    /// As each reports on the whole household, only one is subscribed to.
+    class ZoneGroupTopology {
+    private:
+	Output &				output;
+	boost::shared_ptr<GUPnPServiceProxy>	proxy;
+	bool					subscribed;
+	static void onZoneGroupStateThat(
+	    GUPnPServiceProxy *	proxy,
+	    char const *	name,
+	    GValue *		zoneGroupState,
+	    gpointer		that)
+	{
+	    static_cast<ZoneGroupTopology *>(that)->output.onZoneGroupState(
+		g_value_get_string(zoneGroupState));
+	}
+    public:
+	ZoneGroupTopology(
+	    Output &		output_,
+	    GUPnPDeviceInfo *	zonePlayerDeviceInfo)
+	:
+	    output(output_),
+	    proxy(gObjectPointer(GUPNP_SERVICE_PROXY(
+		gupnp_device_info_get_service(zonePlayerDeviceInfo,
+		    "urn:schemas-upnp-org:service:ZoneGroupTopology:1")))),
+	    subscribed(false)
+	{
+	}
+	bool subscribe() {
+	    if (proxy && !subscribed) {
+		gupnp_service_proxy_add_notify(proxy.get(),
+		    "ZoneGroupState",
+		    G_TYPE_STRING,
+		    onZoneGroupStateThat,
+		    this);
+		gupnp_service_proxy_set_subscribed(proxy.get(), true);
+		subscribed = true;
+	    }
+	    return subscribed;
+	}
+	bool isSubscribed() const {return subscribed;}
+	~ZoneGroupTopology() {
+	    if (subscribed) {
+		gupnp_service_proxy_remove_notify(proxy.get(),
+		    "ZoneGroupState",
+		    onZoneGroupStateThat,
+		    this);
+		gupnp_service_proxy_set_subscribed(proxy.get(), false);
+	    }
+	}
+    };
+
+    /// A DeviceCache persists what is needed to rebuild the device proxy
+    /// of each matching renderer (its UDN, friendly name, description URL,
+    /// URL base and the type, control and event URLs of each service)
+    /// so that, on startup, it may be used before it is discovered.
+    /// The cache file is rewritten (atomically) whenever it changes.
+    class DeviceCache {
+    public:
+	struct ServiceEntry {
+	    std::string	type;
+	    std::string	controlUrl;
+	    std::string	eventUrl;
+	    bool operator==(ServiceEntry const & that) const {
+		return type == that.type
+		    && controlUrl == that.controlUrl
+		    && eventUrl == that.eventUrl;
+	    }
+	};
+	struct Entry {
+	    std::string			name;
+	    std::string			location;
+	    std::string			urlBase;
+	    std::list<ServiceEntry>	services;
+	    bool operator==(Entry const & that) const {
+		return name == that.name
+		    && location == that.location
+		    && urlBase == that.urlBase
+		    && services == that.services;
+	    }
+	    bool operator!=(Entry const & that) const {return !(*this == that);}
+	};
+	/// Entries are mapped by UDN
+	typedef std::map<std::string, Entry> Entries;
+    private:
+	std::string	path;
+	Entries		entries;
+	static std::string escape(std::string const & value) {
+	    std::string escaped;
+	    for (std::string::const_iterator it = value.begin();
+		    value.end() != it; ++it) {
+		switch (*it) {
+		    case '&':	escaped += "&amp;";	break;
+		    case '<':	escaped += "&lt;";	break;
+		    case '>':	escaped += "&gt;";	break;
+		    case '"':	escaped += "&quot;";	break;
+		    default:	escaped += *it;		break;
+		}
+	    }
+	    return escaped;
+	}
+	/// \return value as a field (with \, tab and newline escaped)
+	static std::string field(std::string const & value) {
+	    std::string escaped;
+	    for (std::string::const_iterator it = value.begin();
+		    value.end() != it; ++it) {
+		switch (*it) {
+		    case '\\':	escaped += "\\\\";	break;
+		    case '\t':	escaped += "\\t";	break;
+		    case '\n':	escaped += "\\n";	break;
+		    case '\r':	escaped += "\\r";	break;
+		    default:	escaped += *it;		break;
+		}
+	    }
+	    return escaped;
+	}
+	/// \return the value of a field
+	static std::string valueOf(std::string const & field) {
+	    std::string value;
+	    for (std::string::const_iterator it = field.begin();
+		    field.end() != it; ++it) {
+		if ('\\' != *it || field.end() == it + 1) {
+		    value += *it;
+		    continue;
+		}
+		switch (*++it) {
+		    case 't':	value += '\t';	break;
+		    case 'n':	value += '\n';	break;
+		    case 'r':	value += '\r';	break;
+		    default:	value += *it;	break;
+		}
+	    }
+	    return value;
+	}
+	/// one line per device followed by one for each of its services,
+	/// with tab separated fields
+	void save() const {
+	    std::string temporary(path + ".tmp");
+	    {
+		std::ofstream o(temporary.c_str());
+		for (Entries::const_iterator it = entries.begin();
+			entries.end() != it; ++it) {
+		    o << "device\t" << field(it->first)
+			<< "\t" << field(it->second.name)
+			<< "\t" << field(it->second.location)
+			<< "\t" << field(it->second.urlBase) << "\n";
+		    for (std::list<ServiceEntry>::const_iterator jt
+				= it->second.services.begin();
+			    it->second.services.end() != jt; ++jt) {
+			o << "service\t" << field(jt->type)
+			    << "\t" << field(jt->controlUrl)
+			    << "\t" << field(jt->eventUrl) << "\n";
+		    }
+		}
+		if (!o.flush()) {
+		    std::cerr << path << ": cannot write cache" << std::endl;
+		    return;
+		}
+	    }
+	    rename(temporary.c_str(), path.c_str());
+	}
+    public:
+	DeviceCache(std::string const & path_)
+	:
+	    path(path_),
+	    entries()
+	{
+	    std::ifstream i(path.c_str());
+	    std::string line;
+	    Entry * entry = 0;
+	    while (std::getline(i, line)) {
+		std::vector<std::string> fields;
+		boost::split(fields, line, boost::is_any_of("\t"));
+		if (5 == fields.size() && "device" == fields[0]) {
+		    entry = &entries[valueOf(fields[1])];
+		    entry->name		= valueOf(fields[2]);
+		    entry->location	= valueOf(fields[3]);
+		    entry->urlBase	= valueOf(fields[4]);
+		} else if (entry && 4 == fields.size() && "service" == fields[0]) {
+		    ServiceEntry service = {valueOf(fields[1]),
+			valueOf(fields[2]), valueOf(fields[3])};
+		    entry->services.push_back(service);
+		} else {
+		    // a record we cannot read makes those after suspect
+		    entry = 0;
+		}
+	    }
+	}
+	Entries const & getEntries() const {return entries;}
+
+	//**************************************************************
+	static Entry entryOf(
+	    GUPnPDeviceInfo *	deviceInfo)	///< of a discovered device
+	/// \return what we would cache of it.
+	//**************************************************************
+	{
+	    Entry entry;
+	    entry.name = gupnp_device_info_get_friendly_name(deviceInfo);
+	    entry.location = gupnp_device_info_get_location(deviceInfo);
+	    char * urlBase = soup_uri_to_string(
+		gupnp_device_info_get_url_base(deviceInfo), false);
+	    entry.urlBase = urlBase;
+	    g_free(urlBase);
+	    GList * services = gupnp_device_info_list_services(deviceInfo);
+	    for (GList * it = services; it; it = it->next) {
+		GUPnPServiceInfo * serviceInfo
+		    = GUPNP_SERVICE_INFO(it->data);
+		char * type = gupnp_service_info_get_service_type(serviceInfo);
+		char * controlUrl
+		    = gupnp_service_info_get_control_url(serviceInfo);
+		char * eventUrl
+		    = gupnp_service_info_get_event_subscription_url(serviceInfo);
+		ServiceEntry service = {
+		    type	? type		: "",
+		    controlUrl	? controlUrl	: "",
+		    eventUrl	? eventUrl	: ""};
+		entry.services.push_back(service);
+		g_free(type);
+		g_free(controlUrl);
+		g_free(eventUrl);
+		g_object_unref(serviceInfo);
+	    }
+	    g_list_free(services);
+	    return entry;
+	}
+
+	void put(std::string const & udn, Entry const & entry) {
+	    Entries::iterator it = entries.find(udn);
+	    if (entries.end() == it || it->second != entry) {
+		entries[udn] = entry;
+		save();
+	    }
+	}
+	void erase(std::string const & udn) {
+	    if (entries.erase(udn)) {
+		save();
+	    }
+	}
+
+	//**************************************************************
+	static GUPnPDeviceProxy * create(
+	    GUPnPContext *	context,
+	    std::string const &	udn,
+	    Entry const &	entry)
+	/// \brief Create a device proxy, as if discovered, from an entry
+	/// by way of a minimal description document built from it.
+	/// \return the proxy (0 if it cannot be created).
+	//**************************************************************
+	{
+	    std::ostringstream description;
+	    description
+		<< "<?xml version=\"1.0\"?>"
+		<< "<root xmlns=\"urn:schemas-upnp-org:device-1-0\">"
+		<< "<device>"
+		<< "<deviceType>urn:schemas-upnp-org:device:MediaRenderer:1"
+		    << "</deviceType>"
+		<< "<friendlyName>" << escape(entry.name) << "</friendlyName>"
+		<< "<UDN>" << escape(udn) << "</UDN>"
+		<< "<serviceList>";
+	    for (std::list<ServiceEntry>::const_iterator it
+			= entry.services.begin();
+		    entry.services.end() != it; ++it) {
+		description
+		    << "<service>"
+		    << "<serviceType>" << escape(it->type) << "</serviceType>"
+		    << "<controlURL>" << escape(it->controlUrl)
+			<< "</controlURL>"
+		    << "<eventSubURL>" << escape(it->eventUrl)
+			<< "</eventSubURL>"
+		    << "</service>";
+	    }
+	    description
+		<< "</serviceList>"
+		<< "</device>"
+		<< "</root>";
+	    std::string const & xml = description.str();
+	    xmlDoc * xmlDocument = xmlReadMemory(xml.data(), xml.size(),
+		entry.location.c_str(), 0, XML_PARSE_NONET);
+	    if (!xmlDocument) {
+		return 0;
+	    }
+	    xmlNode * element = xmlDocGetRootElement(xmlDocument)->children;
+	    boost::shared_ptr<GUPnPXMLDoc> document(
+		gupnp_xml_doc_new(xmlDocument),	// owns xmlDocument
+		g_object_unref);
+	    boost::shared_ptr<SoupURI> urlBase(
+		soup_uri_new(entry.urlBase.c_str()),
+		soup_uri_free);
+	    if (!urlBase) {
+		return 0;
+	    }
+	    return gupnp_resource_factory_create_device_proxy(
+		gupnp_resource_factory_get_default(),
+		context,
+		document.get(),
+		element,
+		udn.c_str(),
+		entry.location.c_str(),
+		urlBase.get());
+	}
+    };
+
+    typedef boost::shared_ptr<AVTransportService>
+					AVTransportServicePointer;
     typedef boost::shared_ptr<RenderingControlService>
 					RenderingControlServicePointer;
-    typedef std::map<std::string, RenderingControlServicePointer>
-					RenderingControlServiceMap;
+    typedef boost::shared_ptr<GroupRenderingControlService>
+					GroupRenderingControlServicePointer;
+    /// A Renderer is the record of a matching renderer:
+    /// its services (which share its queue and cache their own state)
+    /// and what we have worked out about it for operations.
+    /// Services are not moved (their callbacks refer to them)
+    /// but their Renderer records are (when others are erased).
+    struct Renderer {
+	std::string				udn;
+	std::string				name;
+	std::string				zone;		///< Sonos
+	Service::QueuePointer			queue;
+	AVTransportServicePointer		avTransportService;
+	RenderingControlServicePointer		renderingControlService;
+	/// if groupVolume (and the renderer offers one)
+	GroupRenderingControlServicePointer	groupRenderingControlService;
+	bool					selected;
+	bool					coordinates;
+	bool					coordinatesOthers;
+    };
+    /// Renderers are kept together (in no particular order)
+    /// to be iterated over for each operation
+    typedef std::vector<Renderer>	Renderers;
+    /// RendererIndex indexes Renderers by UDN
+    typedef std::unordered_map<std::string, size_t>
+					RendererIndex;
+    typedef boost::shared_ptr<ZoneGroupTopology>
+					ZoneGroupTopologyPointer;
+    typedef std::map<std::string, ZoneGroupTopologyPointer>
+					ZoneGroupTopologyMap;
+    typedef ZoneGroups::Coordinators	Coordinators;
     size_t				verbose;
     boost::regex			match;
-    AVTransportServiceMap		avTransportServiceMap;
-    RenderingControlServiceMap		renderingControlServiceMap;
+    size_t				concurrency;
+    bool				absolute;
+    bool				group;
+    bool				groupVolume;
+    // owned before (and so released after) what they serve
+    boost::shared_ptr<GUPnPContext>	context;
+    boost::shared_ptr<GUPnPControlPoint>	controlPoint;
+    boost::shared_ptr<GUPnPControlPoint>	zonePlayerControlPoint;
+    Renderers				renderers;
+    RendererIndex			rendererIndex;
+    ZoneGroupTopologyMap		zoneGroupTopologyMap;
+    Coordinators			coordinators;
+    /// renderers selected for operations (all, if empty)
+    boost::regex			selection;
+    bool				preconnect;
+    boost::shared_ptr<DeviceCache>	deviceCache;
+    /// UDNs of renderers started from our deviceCache
+    /// that have yet to be confirmed by discovery
+    std::set<std::string>		unconfirmed;
+    /// source of our expireUnconfirmed timeout (0 if none)
+    guint				expiry;
+    int					connectionsPerHost;
+    int					connections;	///< at most
 
+    /// seconds for discovery to confirm what was started from our deviceCache
+    enum {Unconfirmed = 30};
+
+    /// the Sonos zone of a device UDN
+    /// (e.g., uuid:RINCON_000E58C0FFEE01400_MR => RINCON_000E58C0FFEE01400)
+    static std::string zoneOf(std::string const & udn) {
+	static std::string const uuid("uuid:");
+	static std::string const mr("_MR");
+	std::string zone(0 == udn.compare(0, uuid.size(), uuid)
+	    ? udn.substr(uuid.size())
+	    : udn);
+	if (mr.size() < zone.size()
+		&& 0 == zone.compare(zone.size() - mr.size(), mr.size(), mr)) {
+	    zone.erase(zone.size() - mr.size());
+	}
+	return zone;
+    }
+    /// is a renderer (by name) selected for operations?
+    bool selected(std::string const & name) const {
+	return selection.empty() || boost::regex_search(name, selection);
+    }
+    /// work out which selected renderers coordinate themselves (and others)
+    void coordinate() {
+	if (group) {
+	    ZoneGroups::coordinate(coordinators, renderers);
+	    return;
+	}
+	for (Renderers::iterator it = renderers.begin();
+		renderers.end() != it; ++it) {
+	    it->coordinates = true;
+	    it->coordinatesOthers = false;
+	}
+    }
+    /// parse the ZoneGroupState XML for our Coordinators
+    void onZoneGroupState(char const * zoneGroupState) {
+	// e.g.,
+	// <ZoneGroups>
+	//   <ZoneGroup Coordinator="RINCON_1" ID="RINCON_1:42">
+	//     <ZoneGroupMember UUID="RINCON_1" ZoneName="Kitchen" .../>
+	//     <ZoneGroupMember UUID="RINCON_2" ZoneName="Den" .../>
+	//   </ZoneGroup>
+	// </ZoneGroups>
+	static boost::regex const element(
+	    "<(ZoneGroup|ZoneGroupMember)\\s[^>]*?"
+	    "\\b(?:Coordinator|UUID)=\"([^\"]*)\"");
+	Coordinators coordinators_;
+	std::string coordinator;
+	for (boost::cregex_iterator it(zoneGroupState,
+			zoneGroupState + strlen(zoneGroupState), element), end;
+		end != it; ++it) {
+	    if ("ZoneGroup" == (*it)[1]) {
+		coordinator = (*it)[2];
+	    } else {
+		coordinators_[(*it)[2]] = coordinator;
+	    }
+	}
+	coordinators.swap(coordinators_);
+	if (verbose) {
+	    for (Coordinators::const_iterator it = coordinators.begin();
+		    coordinators.end() != it; ++it) {
+		std::cout << "zone group:\t" << it->first
+		    << " coordinated by " << it->second << std::endl;
+	    }
+	}
+	coordinate();
+	for (Renderers::iterator it = renderers.begin();
+		renderers.end() != it; ++it) {
+	    if (it->groupRenderingControlService) {
+		it->groupRenderingControlService->regroup();
+	    }
+	}
+    }
+    void zonePlayerAvailable(
+	GUPnPControlPoint *	controlPoint,
+	GUPnPDeviceProxy *	zonePlayerDevice)
+    {
+	GUPnPDeviceInfo * zonePlayerDeviceInfo
+	    = GUPNP_DEVICE_INFO(zonePlayerDevice);
+	std::string udn(gupnp_device_info_get_udn(zonePlayerDeviceInfo));
+	if (verbose) {
+	    std::cout << "zone player available:\t" << udn << std::endl;
+	}
+	if (zoneGroupTopologyMap.end() == zoneGroupTopologyMap.find(udn)) {
+	    ZoneGroupTopologyPointer zoneGroupTopologyPointer(
+		new ZoneGroupTopology(*this, zonePlayerDeviceInfo));
+	    zoneGroupTopologyMap[udn] = zoneGroupTopologyPointer;
+	    subscribeZoneGroupTopology();
+	}
+    }
+    static void zonePlayerAvailableThat(
+	GUPnPControlPoint *	controlPoint,
+	GUPnPDeviceProxy *	zonePlayerDevice,
+	gpointer		that)
+    {
+	static_cast<Output *>(that)->zonePlayerAvailable(
+	    controlPoint, zonePlayerDevice);
+    }
+    void zonePlayerUnavailable(
+	GUPnPControlPoint *	controlPoint,
+	GUPnPDeviceProxy *	zonePlayerDevice)
+    {
+	std::string udn(gupnp_device_info_get_udn(
+	    GUPNP_DEVICE_INFO(zonePlayerDevice)));
+	if (verbose) {
+	    std::cout << "zone player unavailable:\t" << udn << std::endl;
+	}
+	zoneGroupTopologyMap.erase(udn);
+	subscribeZoneGroupTopology();
+    }
+    static void zonePlayerUnavailableThat(
+	GUPnPControlPoint *	controlPoint,
+	GUPnPDeviceProxy *	zonePlayerDevice,
+	gpointer		that)
+    {
+	static_cast<Output *>(that)->zonePlayerUnavailable(
+	    controlPoint, zonePlayerDevice);
+    }
+    /// make sure that one ZoneGroupTopology is subscribed to
+    void subscribeZoneGroupTopology() {
+	for (ZoneGroupTopologyMap::iterator it = zoneGroupTopologyMap.begin();
+		zoneGroupTopologyMap.end() != it; ++it) {
+	    if (it->second->isSubscribed()) return;
+	}
+	for (ZoneGroupTopologyMap::iterator it = zoneGroupTopologyMap.begin();
+		zoneGroupTopologyMap.end() != it; ++it) {
+	    if (it->second->subscribe()) return;
+	}
+    }
+
+    static void requestQueuedThat(
+	SoupSession *	session,
+	SoupMessage *	message,
+	gpointer	that)
+    {
+	++Metrics::getInstance()->httpRequests;
+    }
+    static void connectionCreatedThat(
+	SoupSession *	session,
+	GObject *	connection,
+	gpointer	that)
+    {
+	++Metrics::getInstance()->httpConnections;
+    }
+    static void preconnected(
+	SoupSession *	session,
+	SoupMessage *	message,
+	gpointer	that)
+    {}
+    /// add (the services of) a renderer
+    void add(
+	char const *		name,
+	GUPnPDeviceInfo *	mediaRendererDeviceInfo)
+    {
+	std::string udn(gupnp_device_info_get_udn(mediaRendererDeviceInfo));
+	{
+	    RendererIndex::const_iterator it = rendererIndex.find(udn);
+	    if (rendererIndex.end() != it) {
+		if (name == renderers[it->second].name) {
+		    // keep using the services we have
+		    return;
+		}
+		// renamed
+		erase(udn);
+	    }
+	}
+	if (preconnect) {
+	    // open a (kept alive) connection to the renderer now
+	    // (with a cheap request of its description)
+	    // so that our first action need not
+	    SoupMessage * message = soup_message_new("HEAD",
+		gupnp_device_info_get_location(mediaRendererDeviceInfo));
+	    if (message) {
+		soup_session_queue_message(
+		    gupnp_context_get_session(context.get()),
+		    message, preconnected, this);
+	    }
+	}
+	// construct our record of the renderer (with its services)
+	// and don't add it until after it is fully constructed
+	// to prevent premature callbacks
+	Renderer renderer;
+	renderer.udn = udn;
+	renderer.name = name;
+	renderer.zone = zoneOf(udn);
+	// the services of a renderer share one queue
+	renderer.queue.reset(new Service::Queue(concurrency));
+	renderer.avTransportService.reset(new AVTransportService(
+	    verbose, name, mediaRendererDeviceInfo, renderer.queue));
+	renderer.renderingControlService.reset(new RenderingControlService(
+	    verbose, name, mediaRendererDeviceInfo, renderer.queue,
+	    absolute));
+	if (groupVolume) {
+	    renderer.groupRenderingControlService.reset(
+		new GroupRenderingControlService(
+		    verbose, name, mediaRendererDeviceInfo, renderer.queue));
+	    // (only if the renderer offers one)
+	    if (!*renderer.groupRenderingControlService) {
+		renderer.groupRenderingControlService.reset();
+	    }
+	}
+	renderer.selected = selected(renderer.name);
+	rendererIndex[udn] = renderers.size();
+	renderers.push_back(renderer);
+	coordinate();
+	sizeConnections();
+    }
+    /// allow (at least) enough connections in all for each renderer
+    /// (and one more) to keep its own alive
+    void sizeConnections() {
+	enum {Connections = 10};	///< of a SoupSession, by default
+	int connections_ = std::max<int>(Connections,
+	    (renderers.size() + 1) * connectionsPerHost);
+	if (connections < connections_) {
+	    connections = connections_;
+	    g_object_set(gupnp_context_get_session(context.get()),
+		"max-conns",	connections,
+		NULL);
+	}
+    }
     void deviceProxyAvailable(
         GUPnPControlPoint *	controlPoint,
         GUPnPDeviceProxy *	mediaRendererDevice)
@@ -304,28 +2191,31 @@ private:
 		std::cout << "renderer available match:\t"
 		    << name << std::endl;
 	    }
-	    if (avTransportServiceMap.end()
-		    == avTransportServiceMap.find(name)) {
-		// construct a new AVTransportService
-		AVTransportServicePointer avTransportServicePointer(
-		    new AVTransportService(
-			verbose, name, mediaRendererDeviceInfo));
-		// don't add it to the map until after it is fully constructed
-		// to prevent premature callbacks
-		avTransportServiceMap[name]
-		    = avTransportServicePointer;
-	    }
-	    if (renderingControlServiceMap.end()
-		    == renderingControlServiceMap.find(name)) {
-		// construct a new RenderingControlService
-		RenderingControlServicePointer renderingControlServicePointer(
-		    new RenderingControlService(
-			verbose, name, mediaRendererDeviceInfo));
-		// don't add it to the map until after it is fully constructed
-		// to prevent premature callbacks
-		renderingControlServiceMap[name]
-		    = renderingControlServicePointer;
+	    if (deviceCache) {
+		std::string udn(
+		    gupnp_device_info_get_udn(mediaRendererDeviceInfo));
+		DeviceCache::Entry entry(
+		    DeviceCache::entryOf(mediaRendererDeviceInfo));
+		if (unconfirmed.erase(udn)) {
+		    DeviceCache::Entries::const_iterator it
+			= deviceCache->getEntries().find(udn);
+		    if (entry == it->second) {
+			// keep using the services we started with
+			if (verbose) {
+			    std::cout << "renderer cache confirmed:\t"
+				<< name << std::endl;
+			}
+			return;
+		    }
+		    // replace those that are stale
+		    erase(udn);
+		}
+		deviceCache->put(udn, entry);
+	    }
+	    if (1 == ++Metrics::getInstance()->renderersDiscovered) {
+		startupPhase("first renderer discovered");
 	    }
+	    add(name, mediaRendererDeviceInfo);
 	} else {
 	    if (verbose) {
 		std::cout << "renderer available mismatch:\t"
@@ -341,6 +2231,23 @@ private:
 	static_cast<Output *>(that)->deviceProxyAvailable(
 	    controlPoint, mediaRendererDevice);
     }
+    /// erase (the services of) a renderer (by UDN)
+    void erase(std::string const & udn) {
+	RendererIndex::iterator it = rendererIndex.find(udn);
+	if (rendererIndex.end() == it) {
+	    return;
+	}
+	// move the last into its place
+	size_t i = it->second;
+	rendererIndex.erase(it);
+	if (renderers.size() - 1 != i) {
+	    std::swap(renderers[i], renderers.back());
+	    rendererIndex[renderers[i].udn] = i;
+	}
+	renderers.pop_back();
+	++Metrics::getInstance()->renderersLost;
+	coordinate();
+    }
     void deviceProxyUnavailable(
 	GUPnPControlPoint *	controlPoint,
 	GUPnPDeviceProxy *	mediaRendererDevice)
@@ -352,108 +2259,1032 @@ private:
 	if (verbose) {
 	    std::cout << "renderer unavailable:\t" << name << std::endl;
 	}
-	{
-	    AVTransportServiceMap::iterator it
-		= avTransportServiceMap.find(name);
-	    if (avTransportServiceMap.end() != it) {
-		avTransportServiceMap.erase(it);
+	std::string udn(gupnp_device_info_get_udn(mediaRendererDeviceInfo));
+	if (deviceCache) {
+	    unconfirmed.erase(udn);
+	    deviceCache->erase(udn);
+	}
+	erase(udn);
+    }
+    /// erase the services of renderers started from our deviceCache
+    /// that discovery has not confirmed
+    gboolean expireUnconfirmed() {
+	for (std::set<std::string>::iterator it = unconfirmed.begin();
+		unconfirmed.end() != it; ++it) {
+	    DeviceCache::Entries::const_iterator jt
+		= deviceCache->getEntries().find(*it);
+	    if (verbose && deviceCache->getEntries().end() != jt) {
+		std::cout << "renderer cache expired:\t"
+		    << jt->second.name << std::endl;
+	    }
+	    erase(*it);
+	    deviceCache->erase(*it);
+	}
+	unconfirmed.clear();
+	expiry = 0;
+	return false;
+    }
+    static gboolean expireUnconfirmedThat(gpointer that) {
+	return static_cast<Output *>(that)->expireUnconfirmed();
+    }
+    static void deviceProxyUnavailableThat(
+	GUPnPControlPoint *	controlPoint,
+	GUPnPDeviceProxy *	mediaRendererDevice,
+	gpointer		that)
+    {
+	static_cast<Output *>(that)->deviceProxyUnavailable(
+	    controlPoint, mediaRendererDevice);
+    }
+public:
+    Output(
+	size_t		verbose_,
+	char const *	interface,
+	unsigned int	port,
+	std::string	match_,
+	size_t		concurrency_,
+	bool		absolute_,
+	bool		group_,
+	bool		groupVolume_,
+	std::string	cache,
+	unsigned int	idleTimeout,
+	bool		preconnect_)
+    throw(std::runtime_error)
+    :
+	verbose(verbose_),
+	match(match_),
+	concurrency(concurrency_),
+	absolute(absolute_),
+	group(group_ || groupVolume_),
+	groupVolume(groupVolume_),
+	context(),
+	controlPoint(),
+	zonePlayerControlPoint(),
+	renderers(),
+	rendererIndex(),
+	zoneGroupTopologyMap(),
+	coordinators(),
+	selection(),
+	preconnect(preconnect_),
+	deviceCache(),
+	unconfirmed(),
+	expiry(0),
+	connectionsPerHost(std::max<int>(2, concurrency)),
+	connections(0)
+    {
+	GError * error = 0;
+	context = gObjectPointer(gupnp_context_new (
+	    NULL,	// GMainContext *
+	    interface,	// network interface
+	    port,	// TCP SOAP server (listening) port. 0 => any port
+	    &error));
+	if (error) {
+	    boost::shared_ptr<GError> errorFree(error, g_error_free);
+	    throw std::runtime_error(error->message);
+	}
+	// all control (SOAP) requests share the HTTP session of our context.
+	// keep (idle) connections to each renderer alive and allow enough
+	// so that our actions in flight need not wait for another's.
+	SoupSession * session = gupnp_context_get_session(context.get());
+	g_object_set(session,
+	    "max-conns-per-host",	connectionsPerHost,
+	    "idle-timeout",		idleTimeout,
+	    NULL);
+	sizeConnections();
+	g_signal_connect(session, "request-queued",
+	    reinterpret_cast<GCallback>(requestQueuedThat), this);
+	g_signal_connect(session, "connection-created",
+	    reinterpret_cast<GCallback>(connectionCreatedThat), this);
+	controlPoint = gObjectPointer(gupnp_control_point_new(
+	    context.get(),
+	    "urn:schemas-upnp-org:device:MediaRenderer:1"));
+	g_signal_connect(
+	    controlPoint.get(),
+	    "device-proxy-available",
+	    reinterpret_cast<GCallback>(deviceProxyAvailableThat),
+	    this);
+	g_signal_connect(
+	    controlPoint.get(),
+	    "device-proxy-unavailable",
+	    reinterpret_cast<GCallback>(deviceProxyUnavailableThat),
+	    this);
+	gssdp_resource_browser_set_active(
+	    GSSDP_RESOURCE_BROWSER(controlPoint.get()), true);
+	if (group) {
+	    // learn the topology of Sonos zone groups
+	    zonePlayerControlPoint = gObjectPointer(gupnp_control_point_new(
+		context.get(),
+		"urn:schemas-upnp-org:device:ZonePlayer:1"));
+	    g_signal_connect(
+		zonePlayerControlPoint.get(),
+		"device-proxy-available",
+		reinterpret_cast<GCallback>(zonePlayerAvailableThat),
+		this);
+	    g_signal_connect(
+		zonePlayerControlPoint.get(),
+		"device-proxy-unavailable",
+		reinterpret_cast<GCallback>(zonePlayerUnavailableThat),
+		this);
+	    gssdp_resource_browser_set_active(
+		GSSDP_RESOURCE_BROWSER(zonePlayerControlPoint.get()), true);
+	}
+	if (!cache.empty()) {
+	    // start with the renderers we found last time
+	    // while discovery confirms (or replaces) them
+	    deviceCache.reset(new DeviceCache(cache));
+	    DeviceCache::Entries const & entries = deviceCache->getEntries();
+	    for (DeviceCache::Entries::const_iterator it = entries.begin();
+		    entries.end() != it; ++it) {
+		if (!boost::regex_match(it->second.name, match)) {
+		    continue;
+		}
+		GUPnPDeviceProxy * mediaRendererDevice
+		    = DeviceCache::create(context.get(), it->first, it->second);
+		if (!mediaRendererDevice) {
+		    continue;
+		}
+		if (verbose) {
+		    std::cout << "renderer cached match:\t"
+			<< it->second.name << std::endl;
+		}
+		add(it->second.name.c_str(),
+		    GUPNP_DEVICE_INFO(mediaRendererDevice));
+		unconfirmed.insert(it->first);
+		g_object_unref(mediaRendererDevice);
+	    }
+	    if (!unconfirmed.empty()) {
+		startupPhase("cached renderers started");
+	    }
+	    expiry = g_timeout_add_seconds(
+		Unconfirmed, expireUnconfirmedThat, this);
+	}
+    }
+    ~Output() {
+	if (expiry) {
+	    g_source_remove(expiry);
+	}
+	// release our renderers (and their subscriptions) while nothing
+	// that might call us back has been released,
+	// then disconnect what would
+	renderers.clear();
+	rendererIndex.clear();
+	zoneGroupTopologyMap.clear();
+	g_signal_handlers_disconnect_by_data(
+	    gupnp_context_get_session(context.get()), this);
+	g_signal_handlers_disconnect_by_data(controlPoint.get(), this);
+	if (zonePlayerControlPoint) {
+	    g_signal_handlers_disconnect_by_data(
+		zonePlayerControlPoint.get(), this);
+	}
+    }
+    void pause(gint64 input) {
+	for (Renderers::iterator it = renderers.begin();
+		renderers.end() != it; ++it) {
+	    if (it->selected && it->coordinates) {
+		it->avTransportService->pause(input);
+	    }
+	}
+    }
+    void play(gint64 input) {
+	for (Renderers::iterator it = renderers.begin();
+		renderers.end() != it; ++it) {
+	    if (it->selected && it->coordinates) {
+		it->avTransportService->play(input);
+	    }
+	}
+    }
+    void previous(gint64 input) {
+	for (Renderers::iterator it = renderers.begin();
+		renderers.end() != it; ++it) {
+	    if (it->selected && it->coordinates) {
+		it->avTransportService->previous(input);
+	    }
+	}
+    }
+    void next(gint64 input) {
+	for (Renderers::iterator it = renderers.begin();
+		renderers.end() != it; ++it) {
+	    if (it->selected && it->coordinates) {
+		it->avTransportService->next(input);
+	    }
+	}
+    }
+    void togglePlay(gint64 input) {
+	for (Renderers::iterator it = renderers.begin();
+		renderers.end() != it; ++it) {
+	    if (it->selected && it->coordinates) {
+		it->avTransportService->togglePlay(input);
+	    }
+	}
+    }
+    void stop(gint64 input) {
+	for (Renderers::iterator it = renderers.begin();
+		renderers.end() != it; ++it) {
+	    if (it->selected && it->coordinates) {
+		it->avTransportService->stop(input);
+	    }
+	}
+    }
+    void seek(std::string const & target, gint64 input) {
+	for (Renderers::iterator it = renderers.begin();
+		renderers.end() != it; ++it) {
+	    if (it->selected && it->coordinates) {
+		it->avTransportService->seek(target, input);
+	    }
+	}
+    }
+    void setRelativeVolume(int adjustment, gint64 input) {
+	for (Renderers::iterator it = renderers.begin();
+		renderers.end() != it; ++it) {
+	    if (!it->selected) {
+		continue;
+	    }
+	    if (it->groupRenderingControlService) {
+		if (!it->coordinates) {
+		    // our group coordinator adjusts our volume
+		    it->renderingControlService->unmute(input);
+		    continue;
+		}
+		if (it->coordinatesOthers) {
+		    it->renderingControlService->unmute(input);
+		    it->groupRenderingControlService->setRelativeGroupVolume(
+			adjustment, input);
+		    continue;
+		}
+	    }
+	    it->renderingControlService->setRelativeVolume(adjustment, input);
+	}
+    }
+    void setVolume(guint volume, gint64 input) {
+	for (Renderers::iterator it = renderers.begin();
+		renderers.end() != it; ++it) {
+	    if (it->selected) {
+		it->renderingControlService->setVolume(volume, input);
+	    }
+	}
+    }
+    void toggleMute(gint64 input) {
+	for (Renderers::iterator it = renderers.begin();
+		renderers.end() != it; ++it) {
+	    if (it->selected) {
+		it->renderingControlService->toggleMute(input);
+	    }
+	}
+    }
+    /// \return the pattern of our selection (empty, if all)
+    std::string getSelection() const {
+	return selection.str();
+    }
+    /// select the matching renderers whose names match regular expression
+    /// pattern anywhere (ignoring case) for subsequent operations
+    /// (all, if empty)
+    void select(std::string const & pattern) {
+	if (verbose) {
+	    std::cout << "renderer select:\t" << pattern << std::endl;
+	}
+	try {
+	    if (pattern.empty()) {
+		selection = boost::regex();
+	    } else {
+		selection.assign(pattern, boost::regex::icase);
+	    }
+	} catch (boost::regex_error & e) {
+	    std::cerr << "renderer select:\t" << pattern << ": " << e.what()
+		<< std::endl;
+	}
+	for (Renderers::iterator it = renderers.begin();
+		renderers.end() != it; ++it) {
+	    it->selected = selected(it->name);
+	}
+	coordinate();
+    }
+    /// \return the number of matching renderers available
+    size_t getRenderers() const {
+	return renderers.size();
+    }
+    /// \return the number of services of matching renderers available
+    size_t getServices() const {
+	size_t services = 0;
+	for (Renderers::const_iterator it = renderers.begin();
+		renderers.end() != it; ++it) {
+	    services += it->groupRenderingControlService ? 3 : 2;
+	}
+	return services;
+    }
+    /// \return true if no renderer action is queued or in flight
+    bool isIdle() const {
+	for (Renderers::const_iterator it = renderers.begin();
+		renderers.end() != it; ++it) {
+	    if (it->queue->getQueued() || it->queue->getInFlight()) {
+		return false;
+	    }
+	}
+	return true;
+    }
+    void printLatencies(std::ostream & o) const {
+	Metrics::getInstance()->printLatencies(o);
+    }
+    /// print our Metrics, and gauges, in the Prometheus text format
+    void printMetrics(std::ostream & o) const {
+	Metrics::getInstance()->print(o);
+	o << "# HELP r2upnpav_renderers Matching renderers available.\n"
+	    << "# TYPE r2upnpav_renderers gauge\n"
+	    << "r2upnpav_renderers " << std::dec
+		<< renderers.size() << "\n";
+	o << "# HELP r2upnpav_actions_queued Renderer actions queued.\n"
+	    << "# TYPE r2upnpav_actions_queued gauge\n";
+	for (Renderers::const_iterator it = renderers.begin();
+		renderers.end() != it; ++it) {
+	    o << "r2upnpav_actions_queued{renderer=";
+	    Metrics::printLabel(o, it->name);
+	    o << "} " << it->queue->getQueued() << "\n";
+	}
+	o << "# HELP r2upnpav_actions_in_flight Renderer actions in flight.\n"
+	    << "# TYPE r2upnpav_actions_in_flight gauge\n";
+	for (Renderers::const_iterator it = renderers.begin();
+		renderers.end() != it; ++it) {
+	    o << "r2upnpav_actions_in_flight{renderer=";
+	    Metrics::printLabel(o, it->name);
+	    o << "} " << it->queue->getInFlight() << "\n";
+	}
+	Metrics const * metrics = Metrics::getInstance();
+	o << "# HELP r2upnpav_services Renderer services alive.\n"
+	    << "# TYPE r2upnpav_services gauge\n"
+	    << "r2upnpav_services " << metrics->services << "\n";
+	o << "# HELP r2upnpav_service_proxies"
+		" Renderer service proxies not yet finalized.\n"
+	    << "# TYPE r2upnpav_service_proxies gauge\n"
+	    << "r2upnpav_service_proxies " << metrics->proxies << "\n";
+	o << "# HELP process_resident_memory_bytes"
+		" Resident memory size in bytes.\n"
+	    << "# TYPE process_resident_memory_bytes gauge\n"
+	    << "process_resident_memory_bytes "
+		<< Metrics::getResidentBytes() << "\n";
+    }
+};
+Output::LastChangeParser * Output::LastChangeParser::instance = 0;
+
+/// Operations is the registry of all operations that inputs may ask of Output.
+/// Its table is sorted (as verified at compile time) by operation name
+/// so that a (case insensitive) name is found by binary search,
+/// and indexed by CEC user control code (once) so that a code is found
+/// directly.
+/// An operation may take an integer or text parameter
+/// (after its name, separated by white space, e.g., "VolumeUp 5").
+/// Adding an operation costs a table entry and its case in Coalescer.
+class Operations {
+public:
+    enum Code {
+	Mute,		///< toggle
+	Next,
+	Pause,
+	Play,
+	PlayPause,	///< toggle (by TransportState)
+	Previous,
+	Renderer,	///< select renderers by (text) pattern, all if none
+	Seek,		///< to (text) H+:MM:SS target
+	Stop,
+	Volume,		///< set to (integer) volume
+	VolumeDown,	///< by (integer) adjustment
+	VolumeUp	///< by (integer) adjustment
+    };
+    enum Parameter {
+	None,
+	Integer,
+	OptionalInteger,	///< defaults to integer
+	Text,
+	OptionalText		///< defaults to empty
+    };
+    struct Operation {
+	char const *	name;
+	Code		code;
+	Parameter	parameter;
+	int		integer;	///< default OptionalInteger
+	int		cec;		///< CEC user control code (or -1)
+	int		cecInteger;	///< Integer parameter from CEC
+	int		minimum;	///< Integer parameter
+	int		maximum;	///< Integer parameter
+    };
+    /// A Command is an Operation with its parameter
+    struct Command {
+	Operation const *	operation;
+	int			integer;
+	std::string		text;
+    };
+    static constexpr Operation table[] = {
+	{"Mute",	Mute,		None,		0,
+	    CEC::CEC_USER_CONTROL_CODE_MUTE,		0},
+	{"Next",	Next,		None,		0,
+	    CEC::CEC_USER_CONTROL_CODE_FORWARD,		0},
+	{"Pause",	Pause,		None,		0,
+	    CEC::CEC_USER_CONTROL_CODE_PAUSE,		0},
+	{"Play",	Play,		None,		0,
+	    CEC::CEC_USER_CONTROL_CODE_PLAY,		0},
+	{"PlayPause",	PlayPause,	None,		0,
+	    CEC::CEC_USER_CONTROL_CODE_PAUSE_PLAY_FUNCTION,	0},
+	{"Previous",	Previous,	None,		0,
+	    CEC::CEC_USER_CONTROL_CODE_BACKWARD,	0},
+	{"Renderer",	Renderer,	OptionalText,	0,	-1,	0},
+	{"Seek",	Seek,		Text,		0,	-1,	0},
+	{"Stop",	Stop,		None,		0,
+	    CEC::CEC_USER_CONTROL_CODE_STOP,		0},
+	{"Volume",	Volume,		Integer,	0,	-1,	0,
+	    0,	100},
+	// CEC volume is adjusted in steps of 2
+	{"VolumeDown",	VolumeDown,	OptionalInteger, 1,
+	    CEC::CEC_USER_CONTROL_CODE_VOLUME_DOWN,	2,	1,	100},
+	{"VolumeUp",	VolumeUp,	OptionalInteger, 1,
+	    CEC::CEC_USER_CONTROL_CODE_VOLUME_UP,	2,	1,	100},
+    };
+    enum {Count = sizeof table / sizeof *table};
+private:
+    static constexpr char lower(char c) {
+	return 'A' <= c && 'Z' >= c ? c - 'A' + 'a' : c;
+    }
+    /// is a before b (ignoring case)?
+    static constexpr bool before(char const * a, char const * b) {
+	return !*b ? false
+	    : !*a ? true
+	    : lower(*a) != lower(*b) ? lower(*a) < lower(*b)
+	    : before(a + 1, b + 1);
+    }
+public:
+    /// is our table sorted (from i)?
+    static constexpr bool sorted(size_t i = 0) {
+	return Count <= i + 1
+	    || (before(table[i].name, table[i + 1].name) && sorted(i + 1));
+    }
+    /// is each Operation in our table (from i) at the index of its code?
+    static constexpr bool indexed(size_t i = 0) {
+	return Count <= i || (i == table[i].code && indexed(i + 1));
+    }
+
+    /// A Key maps a Linux input event key code to an Operation
+    struct Key {
+	unsigned short	key;		///< KEY_* code
+	Code		code;
+	int		integer;	///< Integer parameter
+    };
+    /// our keys are sorted by key code so that one may be found
+    /// by binary search
+    static constexpr Key keys[] = {
+	{KEY_MUTE,		Mute,		0},
+	{KEY_VOLUMEDOWN,	VolumeDown,	1},
+	{KEY_VOLUMEUP,		VolumeUp,	1},
+	{KEY_PAUSE,		Pause,		0},
+	{KEY_STOP,		Stop,		0},
+	{KEY_NEXTSONG,		Next,		0},
+	{KEY_PLAYPAUSE,		PlayPause,	0},
+	{KEY_PREVIOUSSONG,	Previous,	0},
+	{KEY_STOPCD,		Stop,		0},
+	{KEY_REWIND,		Previous,	0},
+	{KEY_PLAYCD,		Play,		0},
+	{KEY_PAUSECD,		Pause,		0},
+	{KEY_PLAY,		Play,		0},
+	{KEY_FASTFORWARD,	Next,		0},
+	{KEY_NEXT,		Next,		0},
+	{KEY_PREVIOUS,		Previous,	0},
+    };
+    enum {Keys = sizeof keys / sizeof *keys};
+    /// are our keys sorted (from i)?
+    static constexpr bool keysSorted(size_t i = 0) {
+	return Keys <= i + 1
+	    || (keys[i].key < keys[i + 1].key && keysSorted(i + 1));
+    }
+
+    //******************************************************************
+    static bool parse(
+	char const *	config,		///< e.g., "VolumeUp 5"
+	Command &	command)	///< parsed
+    /// \return false if config is not that of a supported operation.
+    //******************************************************************
+    {
+	size_t length = strcspn(config, " \t");
+	Operation const * low = table;
+	Operation const * high = table + Count;
+	while (low < high) {
+	    Operation const * middle = low + (high - low) / 2;
+	    int compare = strncasecmp(config, middle->name, length);
+	    if (!compare && middle->name[length]) compare = -1;
+	    if (!compare) {
+		char const * parameter = config + length;
+		parameter += strspn(parameter, " \t");
+		command.operation	= middle;
+		command.integer		= middle->integer;
+		command.text		= parameter;
+		switch (middle->parameter) {
+		    case None:
+			return !*parameter;
+		    case Integer:
+		    case OptionalInteger:
+			if (*parameter) {
+			    char * end;
+			    errno = 0;
+			    long integer = strtol(parameter, &end, 10);
+			    if (*end || errno
+				    || middle->minimum > integer
+				    || middle->maximum < integer) {
+				return false;
+			    }
+			    command.integer = integer;
+			    return true;
+			}
+			return OptionalInteger == middle->parameter;
+		    case Text:
+			return *parameter;
+		    case OptionalText:
+			return true;
+		}
+		return false;
+	    }
+	    if (0 > compare) high = middle; else low = middle + 1;
+	}
+	return false;
+    }
+
+    //******************************************************************
+    static bool parse(
+	int		cec,		///< CEC user control code
+	Command &	command)	///< parsed
+    /// \return false if cec is not that of a supported operation.
+    //******************************************************************
+    {
+	static struct Index {
+	    Operation const * operations[256];
+	    Index() {
+		memset(operations, 0, sizeof operations);
+		for (size_t i = 0; i < Count; ++i) {
+		    if (0 <= table[i].cec) operations[table[i].cec] = table + i;
+		}
+	    }
+	} const index;
+	if (0 > cec || 256 <= cec || !index.operations[cec]) {
+	    return false;
+	}
+	command.operation	= index.operations[cec];
+	command.integer		= command.operation->cecInteger;
+	command.text.clear();
+	return true;
+    }
+
+    //******************************************************************
+    static bool parseKey(
+	unsigned int	key,		///< Linux input event key code
+	Command &	command)	///< parsed
+    /// \return false if key is not that of a supported operation.
+    //******************************************************************
+    {
+	Key const * low = keys;
+	Key const * high = keys + Keys;
+	while (low < high) {
+	    Key const * middle = low + (high - low) / 2;
+	    if (key == middle->key) {
+		command.operation	= table + middle->code;
+		command.integer		= middle->integer;
+		command.text.clear();
+		return true;
+	    }
+	    if (key < middle->key) high = middle; else low = middle + 1;
+	}
+	return false;
+    }
+};
+constexpr Operations::Operation Operations::table[];
+static_assert(Operations::sorted(), "Operations::table must be sorted");
+static_assert(Operations::indexed(), "Operations::table must be by Code");
+constexpr Operations::Key Operations::keys[];
+static_assert(Operations::keysSorted(), "Operations::keys must be sorted");
+
+/// A Ramp accelerates the volume adjustments of a held key.
+/// A hold begins with a press (a LIRC code that is not a repeat)
+/// or with a change in direction, continues with the (CEC or LIRC)
+/// repeats that come while it is held and ends when it is released
+/// (by CEC) or when no repeat has come for a while.
+/// The step of each repeat grows with the time the key has been held
+/// (by curve times the seconds held) but never beyond maxStep.
+class Ramp {
+private:
+    enum {Gap = 500000};	///< microseconds, at most, between repeats
+    double		curve;
+    unsigned int	maxStep;
+    int			direction;	///< of hold (0 if none)
+    gint64		begun;		///< time of hold
+    gint64		last;		///< time of last repeat
+public:
+    Ramp(double curve_, unsigned int maxStep_)
+    :
+	curve(curve_),
+	maxStep(maxStep_),
+	direction(0),
+	begun(0),
+	last(0)
+    {}
+    /// end the hold (if any)
+    void release() {direction = 0;}
+    /// \return the accelerated step for an adjustment at time
+    int step(int adjustment, gint64 time) {
+	int direction_ = 0 > adjustment ? -1 : 1;
+	if (direction != direction_ || Gap < time - last) {
+	    direction = direction_;
+	    begun = time;
+	}
+	last = time;
+	double held = static_cast<double>(time - begun) / G_USEC_PER_SEC;
+	unsigned int magnitude = static_cast<unsigned int>(
+	    std::abs(adjustment) * (1 + curve * held) + 0.5);
+	return direction * static_cast<int>(
+	    std::min(std::max(maxStep, static_cast<unsigned int>(
+		std::abs(adjustment))), magnitude));
+    }
+};
+
+/// A Trace is a compact binary record of what all inputs give a Coalescer
+/// so that it may be replayed. It is Magic followed by Events, each
+///	gint64		time	microseconds since recording began
+///	uint8		kind	Source, Perform, Release or Commit
+///	uint8		source	index (as defined by a Source Event)
+///	uint8		code	Operations::Code (of Perform)
+///	int32		integer	parameter (of Perform)
+///	uint16		size	of text that follows (Source name or parameter)
+/// in host byte order.
+class Trace {
+public:
+    enum Kind {Source, Perform, Release, Commit};
+    struct Event {
+	gint64		time;
+	uint8_t		kind;
+	uint8_t		source;
+	uint8_t		code;
+	int32_t		integer;
+	std::string	text;
+    };
+    static char const * magic() {return "r2uptrc1";}
+    enum {MagicSize = 8};
+    static void write(std::ostream & o, Event const & event) {
+	uint16_t size = std::min<size_t>(UINT16_MAX, event.text.size());
+	o.write(reinterpret_cast<char const *>(&event.time),
+	    sizeof event.time);
+	o.put(event.kind).put(event.source).put(event.code);
+	o.write(reinterpret_cast<char const *>(&event.integer),
+	    sizeof event.integer);
+	o.write(reinterpret_cast<char const *>(&size), sizeof size);
+	o.write(event.text.data(), size);
+    }
+    /// \return false at the end of i (or if what is left is incomplete)
+    static bool read(std::istream & i, Event & event) {
+	uint16_t size;
+	char kind, source, code;
+	if (!i.read(reinterpret_cast<char *>(&event.time), sizeof event.time)
+		|| !i.get(kind).get(source).get(code)
+		|| !i.read(reinterpret_cast<char *>(&event.integer),
+		    sizeof event.integer)
+		|| !i.read(reinterpret_cast<char *>(&size), sizeof size)) {
+	    return false;
+	}
+	event.kind	= kind;
+	event.source	= source;
+	event.code	= code;
+	event.text.resize(size);
+	return !size || i.read(&event.text[0], size);
+    }
+};
+
+/// A Recorder writes a Trace of what all inputs give a Coalescer.
+class Recorder {
+private:
+    typedef std::map<Metrics::InputMetrics const *, uint8_t> Sources;
+    std::ofstream	file;
+    gint64		begun;
+    Sources		sources;
+    void write(
+	uint8_t			kind,
+	gint64			time,
+	uint8_t			source = 0,
+	uint8_t			code = 0,
+	int32_t			integer = 0,
+	std::string const &	text = std::string())
+    {
+	Trace::Event event = {std::max<gint64>(0, time - begun),
+	    kind, source, code, integer, text};
+	Trace::write(file, event);
+    }
+public:
+    Recorder(char const * path) throw(std::runtime_error)
+    :
+	file(path, std::ios::binary | std::ios::trunc),
+	begun(g_get_monotonic_time()),
+	sources()
+    {
+	if (!file) {
+	    throw std::runtime_error(std::string(path) + ": cannot write");
+	}
+	file.write(Trace::magic(), Trace::MagicSize);
+    }
+    void perform(
+	Metrics::InputMetrics const &	metrics,
+	Operations::Command const &	command,
+	gint64				time)
+    {
+	if (!time) {
+	    time = g_get_monotonic_time();
+	}
+	Sources::iterator it = sources.find(&metrics);
+	if (sources.end() == it) {
+	    it = sources.insert(Sources::value_type(
+		&metrics, sources.size())).first;
+	    write(Trace::Source, time, it->second, 0, 0,
+		Metrics::getInstance()->getSource(metrics));
+	}
+	write(Trace::Perform, time, it->second,
+	    command.operation->code, command.integer, command.text);
+    }
+    void release() {
+	write(Trace::Release, g_get_monotonic_time());
+    }
+    void commit() {
+	write(Trace::Commit, g_get_monotonic_time());
+    }
+};
+
+/// A Coalescer batches up the operations of all inputs (LIRC and CEC)
+/// so that a gesture results in as few Output operations as possible:
+/// play and pause cancel each other (as do next and previous),
+/// volume adjustments add up and mute toggles cancel in pairs.
+/// Stop, Seek and Volume (absolute) replace those before them in a batch.
+/// PlayPause toggles a Play or Pause before it in a batch.
+/// Renderer (selection) performs the batch before it.
+/// A batch is performed when an input commits what it has read
+/// or, with a window, that many milliseconds after its first operation
+/// (so that the IR and CEC codes of one remote may be batched together).
+/// Volume adjustments (of a Ramp) are written at most rate times a second;
+/// those that come sooner are added to the next.
+class Coalescer {
+private:
+    /// A Slot accumulates the operations of one kind in a batch
+    class Slot {
+    private:
+	int				net;
+	int				operations;
+	Metrics::InputMetrics *		first;	///< input of the first
+    public:
+	Slot() : net(0), operations(0), first(0) {}
+	int getNet() const {return net;}
+	int getOperations() const {return operations;}
+	void add(Metrics::InputMetrics & metrics, int value) {
+	    if (operations++) {
+		++metrics.coalesced;
+	    } else {
+		first = &metrics;
+	    }
+	    net += value;
+	}
+	/// replace what we have with value
+	void set(Metrics::InputMetrics & metrics, int value) {
+	    add(metrics, value - net);
+	}
+	/// \return the net value and start over.
+	/// a first operation cancelled by others is coalesced too.
+	int take() {
+	    int net_ = net;
+	    if (operations && !net_) {
+		++first->coalesced;
 	    }
+	    *this = Slot();
+	    return net_;
 	}
-	{
-	    RenderingControlServiceMap::iterator it
-		= renderingControlServiceMap.find(name);
-	    if (renderingControlServiceMap.end() != it) {
-		renderingControlServiceMap.erase(it);
+    };
+    size_t		verbose;
+    unsigned int	window;		///< milliseconds
+    Output &		output;
+    Slot		stopping;	///< 1 to stop
+    Slot		playing;	///< + play, - pause (after any stop)
+    Slot		playToggles;	///< (if not playing or pausing)
+    Slot		skipping;	///< + next, - previous
+    Slot		seeking;	///< 1 to seek
+    std::string		seekTarget;
+    Slot		volumeSetting;	///< 1 + volume to set (before adjustment)
+    Slot		volumeAdjustment;
+    Slot		muteToggles;
+    Ramp		ramp;
+    unsigned int	rate;		///< of volume writes, at most
+    gint64		volumeWritable;	///< time of next volume write
+    gint64		input;		///< time of first operation
+    guint		timer;
+    Recorder *		recorder;	///< of what we are given (or 0)
+    void add(
+	Slot &			slot,
+	Metrics::InputMetrics &	metrics,
+	int			value,
+	gint64			time,
+	bool			replace = false)
+    {
+	if (!input || time < input) {
+	    input = time;
+	}
+	replace ? slot.set(metrics, value) : slot.add(metrics, value);
+	if (window && !timer) {
+	    timer = g_timeout_add(window, flushThat, this);
+	}
+    }
+    /// perform the batch (but for any volume adjustment it is too soon
+    /// for, unless forced)
+    void flush(bool force = false) {
+	if (!input) {
+	    return;
+	}
+	gint64 input_ = input;
+	input = 0;
+	gint64 now = g_get_monotonic_time();
+	if (!force && rate && now < volumeWritable
+		&& volumeAdjustment.getOperations()
+		&& !volumeSetting.getOperations()) {
+	    // keep it (and its input time) for when it is not too soon
+	    input = input_;
+	    if (!timer) {
+		timer = g_timeout_add((volumeWritable - now + 999) / 1000,
+		    flushThat, this);
 	    }
 	}
+	int stop	= stopping.take();
+	int play	= playing.take();
+	int playToggle	= playToggles.take() & 1;
+	int next	= skipping.take();
+	int seek	= seeking.take();
+	int volume	= volumeSetting.take();
+	int adjustment	= input ? 0 : volumeAdjustment.take();
+	int toggles	= muteToggles.take();
+	if (verbose) {
+	    std::cout << "\tcoalesced:"
+		<< "\tstop " << std::dec << stop
+		<< "\tplay " << play << " " << playToggle
+		<< "\tnext " << next
+		<< "\tseek " << seek
+		<< "\tvolume " << volume - 1 << " " << adjustment
+		<< "\tmute " << toggles
+		<< std::endl;
+	}
+	if (stop) {
+	    output.stop(input_);
+	}
+	if (play) {
+	    0 > play ? output.pause(input_) : output.play(input_);
+	} else if (playToggle) {
+	    output.togglePlay(input_);
+	}
+	if (next) {
+	    0 > next ? output.previous(input_) : output.next(input_);
+	}
+	if (seek) {
+	    output.seek(seekTarget, input_);
+	}
+	if (volume) {
+	    output.setVolume(std::max(0, volume - 1 + adjustment), input_);
+	} else if (adjustment) {
+	    output.setRelativeVolume(adjustment, input_);
+	}
+	if (volume || adjustment) {
+	    volumeWritable = rate ? now + G_USEC_PER_SEC / rate : 0;
+	}
+	if (toggles & 1) {
+	    output.toggleMute(input_);
+	}
     }
-    static void deviceProxyUnavailableThat(
-	GUPnPControlPoint *	controlPoint,
-	GUPnPDeviceProxy *	mediaRendererDevice,
-	gpointer		that)
-    {
-	static_cast<Output *>(that)->deviceProxyUnavailable(
-	    controlPoint, mediaRendererDevice);
+    /// forget what a slot has for what replaces it
+    static void forget(Slot & slot, Metrics::InputMetrics & metrics) {
+	if (slot.getOperations()) {
+	    ++metrics.coalesced;
+	    slot.take();
+	}
+    }
+    static gboolean flushThat(gpointer that) {
+	Coalescer * coalescer = static_cast<Coalescer *>(that);
+	coalescer->timer = 0;
+	coalescer->flush();
+	return G_SOURCE_REMOVE;
     }
 public:
-    Output(
+    Coalescer(
 	size_t		verbose_,
-	char const *	interface,
-	unsigned int	port,
-	std::string	match_)
-    throw(std::runtime_error)
+	unsigned int	window_,
+	Output &	output_,
+	double		curve,		///< of Ramp
+	unsigned int	maxStep,	///< of Ramp
+	unsigned int	rate_)		///< of volume writes, at most
     :
 	verbose(verbose_),
-	match(match_),
-	avTransportServiceMap(),
-	renderingControlServiceMap()
-    {
-	GError * error = 0;
-	GUPnPContext * context = gupnp_context_new (
-	    NULL,	// GMainContext *
-	    interface,	// network interface
-	    port,	// TCP SOAP server (listening) port. 0 => any port
-	    &error);
-	if (error) {
-	    boost::shared_ptr<GError> errorFree(error, g_error_free);
-	    throw std::runtime_error(error->message);
+	window(window_),
+	output(output_),
+	stopping(),
+	playing(),
+	playToggles(),
+	skipping(),
+	seeking(),
+	seekTarget(),
+	volumeSetting(),
+	volumeAdjustment(),
+	muteToggles(),
+	ramp(curve, maxStep),
+	rate(rate_),
+	volumeWritable(0),
+	input(0),
+	timer(0),
+	recorder(0)
+    {}
+    ~Coalescer() {
+	if (timer) {
+	    g_source_remove(timer);
 	}
-	GUPnPControlPoint * controlPoint = gupnp_control_point_new(
-	    context,
-	    "urn:schemas-upnp-org:device:MediaRenderer:1");
-	g_signal_connect(
-	    controlPoint,
-	    "device-proxy-available",
-	    reinterpret_cast<GCallback>(deviceProxyAvailableThat),
-	    this);
-	g_signal_connect(
-	    controlPoint,
-	    "device-proxy-unavailable",
-	    reinterpret_cast<GCallback>(deviceProxyUnavailableThat),
-	    this);
-	gssdp_resource_browser_set_active(
-	    GSSDP_RESOURCE_BROWSER(controlPoint), true);
     }
-    void pause() {
-	for (AVTransportServiceMap::iterator it = avTransportServiceMap.begin();
-		avTransportServiceMap.end() != it; ++it) {
-	    it->second.get()->pause();
+    void perform(
+	Metrics::InputMetrics &		metrics,
+	Operations::Command const &	command,
+	gint64				time)
+    {
+	if (recorder) {
+	    recorder->perform(metrics, command, time);
 	}
-    }
-    void play() {
-	for (AVTransportServiceMap::iterator it = avTransportServiceMap.begin();
-		avTransportServiceMap.end() != it; ++it) {
-	    it->second.get()->play();
+	switch (command.operation->code) {
+	    case Operations::Mute:
+		add(muteToggles, metrics, 1, time);
+		break;
+	    case Operations::Next:
+		add(skipping, metrics, +1, time);
+		break;
+	    case Operations::Pause:
+		forget(playToggles, metrics);
+		add(playing, metrics, -1, time);
+		break;
+	    case Operations::Play:
+		forget(playToggles, metrics);
+		add(playing, metrics, +1, time);
+		break;
+	    case Operations::PlayPause:
+		if (int play = playing.getNet()) {
+		    // toggle what we will do
+		    add(playing, metrics, 0 > play ? +1 : -1, time, true);
+		} else {
+		    add(playToggles, metrics, 1, time);
+		}
+		break;
+	    case Operations::Previous:
+		add(skipping, metrics, -1, time);
+		break;
+	    case Operations::Renderer:
+		// operations before (and after) are for different renderers
+		if (timer) {
+		    g_source_remove(timer);
+		    timer = 0;
+		}
+		flush(true);
+		output.select(command.text);
+		break;
+	    case Operations::Seek:
+		seekTarget = command.text;
+		add(seeking, metrics, 1, time, true);
+		break;
+	    case Operations::Stop:
+		// forget any play/pause before
+		forget(playing, metrics);
+		forget(playToggles, metrics);
+		add(stopping, metrics, 1, time, true);
+		break;
+	    case Operations::Volume:
+		// forget any adjustment before
+		forget(volumeAdjustment, metrics);
+		add(volumeSetting, metrics,
+		    1 + std::max(0, command.integer), time, true);
+		break;
+	    case Operations::VolumeDown:
+		add(volumeAdjustment, metrics,
+		    ramp.step(-command.integer, time), time);
+		break;
+	    case Operations::VolumeUp:
+		add(volumeAdjustment, metrics,
+		    ramp.step(+command.integer, time), time);
+		break;
 	}
     }
-    void previous() {
-	for (AVTransportServiceMap::iterator it = avTransportServiceMap.begin();
-		avTransportServiceMap.end() != it; ++it) {
-	    it->second.get()->previous();
+    /// a key was released (or a new one pressed)
+    void release() {
+	if (recorder) {
+	    recorder->release();
 	}
+	ramp.release();
     }
-    void next() {
-	for (AVTransportServiceMap::iterator it = avTransportServiceMap.begin();
-		avTransportServiceMap.end() != it; ++it) {
-	    it->second.get()->next();
+    /// an input has added all it has read (for now).
+    /// without a window, perform the batch now.
+    void commit() {
+	if (recorder) {
+	    recorder->commit();
 	}
-    }
-    void setRelativeVolume(int adjustment) {
-	for (RenderingControlServiceMap::iterator it
-		    = renderingControlServiceMap.begin();
-		renderingControlServiceMap.end() != it; ++it) {
-	    it->second.get()->setRelativeVolume(adjustment);
+	if (!window) {
+	    flush();
 	}
     }
-    void toggleMute() {
-	for (RenderingControlServiceMap::iterator it
-		    = renderingControlServiceMap.begin();
-		renderingControlServiceMap.end() != it; ++it) {
-	    it->second.get()->toggleMute();
-	}
+    /// record what we are given (until 0)
+    void record(Recorder * recorder_) {
+	recorder = recorder_;
     }
 };
-Output::LastChangeParser * Output::LastChangeParser::instance = 0;
 
 /// An LircInput object is created to handle all LIRC daemon input
 class LircInput {
@@ -505,81 +3336,197 @@ private:
 	operator GIOChannel * () const {return channel;}
 	~Channel() {g_io_channel_unref(channel);}
     };
+    /// An Inotify watches the directory of our lircrc file
+    /// (editors often replace a file rather than write it)
+    /// for it to be completely written or moved in place
+    /// (not created, which would reload it before it is written)
+    class Inotify {
+    public:
+	int		fd;
+	std::string	name;	///< of lircrc file in directory
+	Inotify(std::string const & lircrc) throw(boost::system::system_error)
+	:
+	    fd(SystemException::throwErrorIfNegative1(
+		inotify_init1(IN_NONBLOCK | IN_CLOEXEC))),
+	    name()
+	{
+	    std::string::size_type slash = lircrc.rfind('/');
+	    std::string directory(std::string::npos == slash ? "."
+		: slash ? lircrc.substr(0, slash) : "/");
+	    name = lircrc.substr(std::string::npos == slash ? 0 : slash + 1);
+	    try {
+		SystemException::throwErrorIfNegative1(
+		    inotify_add_watch(fd, directory.c_str(),
+			IN_CLOSE_WRITE | IN_MOVED_TO));
+	    } catch (...) {
+		close(fd);
+		throw;
+	    }
+	}
+	/// \return true if our lircrc file has changed
+	bool changed() {
+	    bool changed_ = false;
+	    char buffer[4096]
+		__attribute__ ((aligned(__alignof__(inotify_event))));
+	    ssize_t size;
+	    while (0 < (size = read(fd, buffer, sizeof buffer))) {
+		for (char * p = buffer; buffer + size > p;) {
+		    inotify_event * event = reinterpret_cast<inotify_event *>(p);
+		    if (event->len && name == event->name) {
+			changed_ = true;
+		    }
+		    p += sizeof *event + event->len;
+		}
+	    }
+	    return changed_;
+	}
+	operator int() const {return fd;}
+	~Inotify() {close(fd);}
+    };
+    /// After our lircd connection drops, we connect again after a backoff
+    /// that doubles (up to a limit) each time a connection fails.
+    enum {
+	BackoffMin	= 500,		///< milliseconds
+	BackoffMax	= 30000		///< milliseconds
+    };
     size_t				verbose;
-    Connection				connection;
-    Config				config;
-    Channel				channel;
+    std::string				program;
+    std::string				lircrc;		///< "" => default
+    boost::shared_ptr<Connection>	connection;
+    boost::shared_ptr<Channel>		channel;
+    guint				watch;		///< of channel
+    /// replaced (not changed) on reload so that one is always in use
+    boost::shared_ptr<Config>		config;
+    boost::shared_ptr<Inotify>		inotify;
+    boost::shared_ptr<Channel>		inotifyChannel;
+    guint				inotifyWatch;
+    guint				hangup;		///< SIGHUP source
+    unsigned int			backoff;	///< milliseconds
+    guint				retry;		///< source
     boost::shared_ptr<GMainLoop>	loop;
-    Output &				output;
+    Coalescer &				coalescer;
+    void connect() throw(boost::system::system_error) {
+	connection.reset(new Connection(verbose, program.c_str()));
+	channel.reset(new Channel(*connection));
+	watch = g_io_add_watch(*channel,
+	    static_cast<GIOCondition>(G_IO_IN | G_IO_HUP | G_IO_ERR),
+	    inputThat, this);
+    }
+    /// forget our dropped connection (our watch of it is removed
+    /// by our caller) and connect again later
+    void disconnect() {
+	std::cerr << "\tlircd connection dropped" << std::endl;
+	// a held button will not be released
+	coalescer.release();
+	watch = 0;
+	channel.reset();
+	connection.reset();
+	reconnect();
+    }
+    void reconnect() {
+	backoff = backoff ? std::min<unsigned int>(2 * backoff, BackoffMax)
+	    : BackoffMin;
+	std::cerr << "\tlircd reconnecting in "
+	    << std::dec << backoff << " ms" << std::endl;
+	retry = g_timeout_add(backoff, retryThat, this);
+    }
+    gboolean retry_() {
+	retry = 0;
+	try {
+	    connect();
+	    std::cerr << "\tlircd reconnected" << std::endl;
+	    backoff = 0;
+	} catch (std::exception & e) {
+	    std::cerr << e.what() << std::endl;
+	    reconnect();
+	}
+	return G_SOURCE_REMOVE;
+    }
+    static gboolean retryThat(gpointer that) {
+	return static_cast<LircInput *>(that)->retry_();
+    }
+    /// read our lircrc file into a new Config and, if that works,
+    /// use it instead of the old one
+    void reload() {
+	try {
+	    config.reset(new Config(lircrc.empty() ? 0 : lircrc.c_str()));
+	    std::cerr << "\tlircrc reloaded" << std::endl;
+	} catch (std::exception & e) {
+	    std::cerr << e.what() << ", keeping the last" << std::endl;
+	}
+    }
+    static gboolean reloadThat(gpointer that) {
+	static_cast<LircInput *>(that)->reload();
+	return G_SOURCE_CONTINUE;
+    }
+    static gboolean inotifyInputThat(
+	GIOChannel *	source,
+	GIOCondition	condition,
+	gpointer	that)
+    {
+	LircInput * lircInput = static_cast<LircInput *>(that);
+	if (lircInput->inotify->changed()) {
+	    lircInput->reload();
+	}
+	return true;
+    }
     gboolean input(
 	GIOChannel *	source,
 	GIOCondition	condition)
     {
 	try {
-	    // batch up operations
-	    int play			= 0;
-	    int next			= 0;
-	    int volumeAdjustment	= 0;
-	    bool toggleMute		= false;
+	    Metrics::InputMetrics & metrics
+		= Metrics::getInstance()->getInput("lirc");
 	    while (true) {
 		char * code;
 		SystemException::throwErrorIfNegative1(
 		    lirc_nextcode(&code));
 	    if (!code) break; // no more codes at this time
+		gint64 input = g_get_monotonic_time();
+		++metrics.received;
 		boost::shared_ptr<char> codeFree(code, free);
 		if (verbose) {
 		    std::cout << "\tlircd code:\t"<< code;
 		}
+		// a code is formatted as "<code> <repeat count> <button> ..."
+		// in hexadecimal. a count of 0 is a press (not a repeat).
+		char * repeat;
+		strtoull(code, &repeat, 16);
+		if (!strtoul(repeat, 0, 16)) {
+		    coalescer.release();
+		}
 		while (true) {
 		    char * operation;
 		    SystemException::throwErrorIfNegative1(
-			lirc_code2char(config, code, &operation));
+			lirc_code2char(*config, code, &operation));
 		if (!operation) break;	// no more operations for this event
 		    if (verbose) {
 			std::cout << "\tlircrc config:\t"
 			    << operation << std::endl;
 		    }
-		    if (0 == strcasecmp("Pause", operation)) {
-			--play;
-		    } else if (0 == strcasecmp("Play", operation)) {
-			++play;
-		    } else if (0 == strcasecmp("Previous", operation)) {
-			--next;
-		    } else if (0 == strcasecmp("Next", operation)) {
-			++next;
-		    } else if (0 == strcasecmp("VolumeUp", operation)) {
-			++volumeAdjustment;
-		    } else if (0 == strcasecmp("VolumeDown", operation)) {
-			--volumeAdjustment;
-		    } else if (0 == strcasecmp("Mute", operation)) {
-			toggleMute = !toggleMute;
+		    Operations::Command command;
+		    if (Operations::parse(operation, command)) {
+			coalescer.perform(metrics, command, input);
 		    } else {
 			std::cerr << "\tlircrc config:\t"
 			    << operation << ": unsupported" << std::endl;
 		    }
 		}
 	    }
-	    // perform batched up operations
-	    if (play) {
-		0 > play ? output.pause() : output.play();
-	    }
-	    if (next) {
-		0 > next ? output.previous() : output.next();
-	    }
-	    if (volumeAdjustment) {
-		output.setRelativeVolume(volumeAdjustment);
-	    }
-	    if (toggleMute) {
-		output.toggleMute();
-	    }
+	    coalescer.commit();
 	} catch (boost::system::system_error & e) {
 	    std::cerr << e.what() << std::endl;
+	    coalescer.commit();
 	    if (boost::system::errc::resource_unavailable_try_again
 		    == e.code()) {
-		std::cerr << "\tlircd connection dropped, exiting" << std::endl;
-		g_main_loop_quit(loop.get());
+		disconnect();
+		return false;
 	    }
 	}
+	if (condition & (G_IO_HUP | G_IO_ERR)) {
+	    disconnect();
+	    return false;
+	}
 	return true;
     }
     static gboolean inputThat(
@@ -592,20 +3539,184 @@ private:
 public:
     LircInput(
 	size_t				verbose_,
-	char const *			program,
-	char const *			lircrc,
+	char const *			program_,
+	char const *			lircrc_,
 	boost::shared_ptr<GMainLoop>	loop_,
-	Output &			output_)
+	Coalescer &			coalescer_)
     throw(boost::system::system_error)
     :
 	verbose(verbose_),
-	connection(verbose, program),
-	config(lircrc),
-	channel(connection),
+	program(program_),
+	lircrc(lircrc_ ? lircrc_ : ""),
+	connection(),
+	channel(),
+	watch(0),
+	config(new Config(lircrc_)),
+	inotify(),
+	inotifyChannel(),
+	inotifyWatch(0),
+	hangup(0),
+	backoff(0),
+	retry(0),
 	loop(loop_),
-	output(output_)
+	coalescer(coalescer_)
     {
-	g_io_add_watch(channel, G_IO_IN, inputThat, this);
+	connect();
+	hangup = g_unix_signal_add(SIGHUP, reloadThat, this);
+	if (!lircrc.empty()) {
+	    try {
+		inotify.reset(new Inotify(lircrc));
+		inotifyChannel.reset(new Channel(*inotify));
+		inotifyWatch = g_io_add_watch(*inotifyChannel, G_IO_IN,
+		    inotifyInputThat, this);
+	    } catch (std::exception & e) {
+		std::cerr << e.what() << std::endl
+		    << "\tlircrc will not be watched" << std::endl;
+		inotify.reset();
+	    }
+	}
+    }
+    ~LircInput() {
+	if (watch) {
+	    g_source_remove(watch);
+	}
+	if (inotifyWatch) {
+	    g_source_remove(inotifyWatch);
+	}
+	if (retry) {
+	    g_source_remove(retry);
+	}
+	g_source_remove(hangup);
+    }
+};
+
+/// An EvdevInput object is created to handle the key events
+/// of a Linux input event device, such as one to which the kernel
+/// (rc-core) decodes infrared, without lircd.
+/// A file of recorded input events may be read instead.
+class EvdevInput {
+private:
+    class Device {
+    public:
+	int	fd;
+	bool	monotonic;	///< event times are g_get_monotonic_time
+	Device(char const * path, bool grab)
+	throw(boost::system::system_error)
+	:
+	    fd(SystemException::throwErrorIfNegative1(
+		open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC))),
+	    monotonic(false)
+	{
+	    int clock = CLOCK_MONOTONIC;
+	    monotonic = !ioctl(fd, EVIOCSCLOCKID, &clock);
+	    try {
+		if (grab) {
+		    SystemException::throwErrorIfNegative1(
+			ioctl(fd, EVIOCGRAB, 1));
+		}
+	    } catch (std::exception & e) {
+		std::cerr << "\tevdev grab failed" << std::endl;
+		close(fd);
+		throw;
+	    }
+	}
+	operator int() const {return fd;}
+	~Device() {close(fd);}
+    };
+    class Channel {
+    private:
+	GIOChannel * channel;
+    public:
+	Channel(int fd) : channel(g_io_channel_unix_new(fd)) {}
+	operator GIOChannel * () const {return channel;}
+	~Channel() {g_io_channel_unref(channel);}
+    };
+    size_t				verbose;
+    Device				device;
+    Channel				channel;
+    guint				watch;
+    Coalescer &				coalescer;
+    gboolean input(
+	GIOChannel *	source,
+	GIOCondition	condition)
+    {
+	Metrics::InputMetrics & metrics
+	    = Metrics::getInstance()->getInput("evdev");
+	input_event events[64];
+	ssize_t size;
+	while (0 < (size = read(device, events, sizeof events))) {
+	    gint64 now = g_get_monotonic_time();
+	    for (size_t i = 0; i < size / sizeof *events; ++i) {
+		input_event const & event = events[i];
+		if (EV_KEY != event.type) {
+		    continue;
+		}
+		if (verbose) {
+		    std::cout << "\tevdev key:\t" << std::dec
+			<< event.code << "\t" << event.value << std::endl;
+		}
+		// a value of 0 is a release, 1 a press and 2 a repeat
+		if (2 != event.value) {
+		    coalescer.release();
+		}
+		if (!event.value) {
+		    continue;
+		}
+		++metrics.received;
+		Operations::Command command;
+		if (Operations::parseKey(event.code, command)) {
+		    coalescer.perform(metrics, command,
+			monotonicTime(event, now));
+		}
+	    }
+	}
+	if (!size || (0 > size && EAGAIN != errno)
+		|| condition & (G_IO_HUP | G_IO_ERR)) {
+	    // end of recorded events or device gone
+	    // (whose hang up would otherwise be polled without end)
+	    std::cerr << "\tevdev input ended" << std::endl;
+	    // a held key will not be released
+	    coalescer.release();
+	    coalescer.commit();
+	    watch = 0;
+	    return false;
+	}
+	coalescer.commit();
+	return true;
+    }
+    gint64 monotonicTime(input_event const & event, gint64 now) const {
+	return device.monotonic
+	    ? G_USEC_PER_SEC * static_cast<gint64>(event.time.tv_sec)
+		+ event.time.tv_usec
+	    : now;
+    }
+    static gboolean inputThat(
+	GIOChannel *	source,
+	GIOCondition	condition,
+	gpointer	that)
+    {
+	return static_cast<EvdevInput *>(that)->input(source, condition);
+    }
+public:
+    EvdevInput(
+	size_t				verbose_,
+	char const *			path,
+	bool				grab,
+	Coalescer &			coalescer_)
+    throw(boost::system::system_error)
+    :
+	verbose(verbose_),
+	device(path, grab),
+	channel(device),
+	watch(g_io_add_watch(channel,
+	    static_cast<GIOCondition>(G_IO_IN | G_IO_HUP | G_IO_ERR),
+	    inputThat, this)),
+	coalescer(coalescer_)
+    {}
+    ~EvdevInput() {
+	if (watch) {
+	    g_source_remove(watch);
+	}
     }
 };
 
@@ -652,19 +3763,15 @@ private:
 		<< "\t" << adapter.get()->ToString(k.keycode)
 		<< std::endl;
 	}
-	if (0 == k.duration) {
-	    try {
-		// we don't handle the operation here;
-		// rather we forward the keycode over a pipe
-		// to be handled where it must be: in the UPnP thread.
-		SystemException::throwErrorIfNegative1(
-		    write(pipe.fds[1], &k.keycode, sizeof k.keycode));
-	    } catch (boost::system::system_error & e) {
-		std::cerr << e.what() << std::endl;
-		close(pipe.fds[1]);
-		pipe.fds[1] = -1;
-	    }
+	// we don't handle the operation (or release) here;
+	// rather we forward the keycode through our ring
+	// to be handled where it must be: in the UPnP thread.
+	KeyEvent keyEvent
+	    = {k.keycode, g_get_monotonic_time(), 0 != k.duration};
+	if (!ring.push(keyEvent)) {
+	    ++overflows;
 	}
+	wake();
 	return 0;
     }
     static int keyPressThat(void * that, CEC::cec_keypress const k) {
@@ -714,8 +3821,9 @@ private:
 	}
 	std::cerr << std::endl;
 	if (CEC::CEC_ALERT_CONNECTION_LOST == a) {
-	    close(pipe.fds[1]);
-	    pipe.fds[1] = -1;
+	    lost = true;
+	    armed = true;
+	    wake();
 	}
 	return 0;
     }
@@ -760,9 +3868,7 @@ private:
 	CEC::ICECAdapter * get() {return adapter.get();}
 	Adapter(
 	    void *		cecInput,
-	    char const *	name,
-	    char const *	port,
-	    uint32_t		timeout)
+	    char const *	name)
 	throw(std::runtime_error)
 	:
 	    configuration(cecInput, name),
@@ -773,35 +3879,480 @@ private:
 	    if (!get()) {
 		throw std::runtime_error("CECInitialize failed");
 	    }
-	    get()->InitVideoStandalone();
-	    CEC::cec_adapter adapters[10];
-	    if (!port && 0 < get()->FindAdapters(adapters, 10, 0)) {
-		port = adapters[0].comm;
+	    get()->InitVideoStandalone();
+	}
+	/// find (if no port) and open an adapter.
+	/// this may block for as long as timeout milliseconds.
+	bool open(char const * port, uint32_t timeout) {
+	    CEC::cec_adapter adapters[10];
+	    if (!port && 0 < get()->FindAdapters(adapters, 10, 0)) {
+		port = adapters[0].comm;
+	    }
+	    return get()->Open(port, timeout);
+	}
+	void close() {
+	    get()->Close();
+	}
+	~Adapter() {
+	    if (get()) {
+		close();
+	    }
+	}
+    };
+    /// Our adapter is opened by an opener thread
+    /// (so as not to block the UPnP thread)
+    /// which wakes the UPnP thread when it is done.
+    enum Open {Opening, Opened, OpenFailed};
+    gpointer open() {
+	gint64 begun = g_get_monotonic_time();
+	bool opened = adapter.open(port.empty() ? 0 : port.c_str(), timeout);
+	openTime = g_get_monotonic_time() - begun;
+	open_ = opened ? Opened : OpenFailed;
+	armed = true;
+	wake();
+	return 0;
+    }
+    static gpointer openThat(gpointer that) {
+	return static_cast<CecInput *>(that)->open();
+    }
+    /// After our connection is lost, our adapter is closed and opened
+    /// again (by another opener thread) after a backoff
+    /// that doubles (up to a limit) each time an open fails.
+    /// Output (with its renderers) is unaffected.
+    enum {
+	BackoffMin	= 500,		///< milliseconds
+	BackoffMax	= 30000		///< milliseconds
+    };
+    gpointer reopen() {
+	adapter.close();
+	return open();
+    }
+    static gpointer reopenThat(gpointer that) {
+	return static_cast<CecInput *>(that)->reopen();
+    }
+    /// reopen later, unless we already will or are
+    void reconnect() {
+	if (retry || Opening == open_) return;
+	backoff = backoff ? std::min<unsigned int>(2 * backoff, BackoffMax)
+	    : BackoffMin;
+	std::cerr << "\tCEC adapter reopening in "
+	    << std::dec << backoff << " ms" << std::endl;
+	retry = g_timeout_add(backoff, retryThat, this);
+    }
+    gboolean retry_() {
+	retry = 0;
+	g_thread_join(opener);
+	open_ = Opening;
+	openReported = false;
+	opener = g_thread_new("CEC reopen", reopenThat, this);
+	return G_SOURCE_REMOVE;
+    }
+    static gboolean retryThat(gpointer that) {
+	return static_cast<CecInput *>(that)->retry_();
+    }
+    /// A KeyEvent is forwarded from the CEC thread to the UPnP thread
+    struct KeyEvent {
+	CEC::cec_user_control_code	keycode;
+	gint64				time;	// g_get_monotonic_time
+	bool				released;
+    };
+    typedef Ring<KeyEvent, 256> KeyEventRing;
+    class EventFd {
+    public:
+	int fd;
+	EventFd() throw(boost::system::system_error)
+	:
+	    fd(SystemException::throwErrorIfNegative1(
+		eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)))
+	{}
+	operator int() const {return fd;}
+	~EventFd() {close(fd);}
+    };
+    /// wake the UPnP thread, if it is not already awake (CEC thread).
+    /// a wake up is armed only when the UPnP thread has emptied our ring
+    /// so there is (at most) one eventfd write per batch of KeyEvents.
+    void wake() {
+	if (armed.exchange(false)) {
+	    uint64_t one = 1;
+	    if (sizeof one != write(eventFd, &one, sizeof one)) {
+		// the eventfd counter cannot overflow at this rate,
+		// so this should not happen. rearm to try again.
+		armed = true;
+	    }
+	}
+    }
+    class Channel {
+    private:
+	GIOChannel * channel;
+    public:
+	Channel(int fd) : channel(g_io_channel_unix_new(fd)) {}
+	operator GIOChannel * () const {return channel;}
+	~Channel() {g_io_channel_unref(channel);}
+    };
+    gboolean input(
+	GIOChannel *	source,
+	GIOCondition	condition)
+    {
+	Metrics::InputMetrics & metrics
+	    = Metrics::getInstance()->getInput("cec");
+	uint64_t count;
+	if (sizeof count != read(eventFd, &count, sizeof count)) {
+	    return true;	// spurious
+	}
+	if (!openReported && Opening != open_) {
+	    openReported = true;
+	    if (Opened == open_) {
+		if (backoff) {
+		    std::cerr << "\tCEC adapter reopened" << std::endl;
+		    backoff = 0;
+		} else {
+		    startupPhase("CEC adapter opened", openTime);
+		}
+	    } else if (backoff) {
+		std::cerr << "\tCEC::ICECAdapter::Open failed" << std::endl;
+		reconnect();
+	    } else {
+		std::cerr << "\tCEC::ICECAdapter::Open failed, exiting"
+		    << std::endl;
+		g_main_loop_quit(loop.get());
+		return true;
+	    }
+	}
+	while (true) {
+	    KeyEvent keyEvent;
+	    while (ring.pop(keyEvent)) {
+		if (keyEvent.released) {
+		    coalescer.release();
+		    continue;
+		}
+		++metrics.received;
+		Operations::Command command;
+		if (Operations::parse(keyEvent.keycode, command)) {
+		    coalescer.perform(metrics, command, keyEvent.time);
+		}
+	    }
+	    // rearm our wake up.
+	    // if we lost a race with a push, take the wake up back
+	    // (or, if the CEC thread took it, a redundant one will come)
+	    // and pop again.
+	    armed = true;
+	if (ring.empty() || !armed.exchange(false)) break;
+	}
+	size_t overflows_ = overflows.exchange(0);
+	metrics.received += overflows_;
+	metrics.overflowed += overflows_;
+	if (overflows_) {
+	    std::cerr << "\tCEC key overflows:\t"
+		<< std::dec << overflows_ << std::endl;
+	}
+	if (lost) {
+	    lost = false;
+	    std::cerr << "\tCEC connection lost" << std::endl;
+	    // a held key will not be released
+	    coalescer.release();
+	    reconnect();
+	}
+	coalescer.commit();
+	return true;
+    }
+    static gboolean inputThat(
+	GIOChannel *	source,
+	GIOCondition	condition,
+	gpointer	that)
+    {
+	return static_cast<CecInput *>(that)->input(source, condition);
+    }
+    size_t				verbose;
+    KeyEventRing			ring;
+    std::atomic<size_t>			overflows;
+    std::atomic<bool>			armed;
+    std::atomic<bool>			lost;
+    std::string				port;
+    uint32_t				timeout;
+    std::atomic<Open>			open_;
+    gint64				openTime;	///< microseconds
+    bool				openReported;
+    EventFd				eventFd;
+    Adapter				adapter;
+    Channel				channel;
+    GThread *				opener;
+    unsigned int			backoff;	///< milliseconds
+    guint				retry;		///< source
+    boost::shared_ptr<GMainLoop>	loop;
+    Coalescer &				coalescer;
+public:
+    CecInput(
+	size_t				verbose_,
+	char const *			name,
+	char const *			port_,
+	uint32_t			timeout_,
+	boost::shared_ptr<GMainLoop>	loop_,
+	Coalescer &			coalescer_)
+    :
+	verbose(verbose_),
+	ring(),
+	overflows(0),
+	armed(true),
+	lost(false),
+	port(port_ ? port_ : ""),
+	timeout(timeout_),
+	open_(Opening),
+	openTime(0),
+	openReported(false),
+	eventFd(),
+	adapter(this, name),
+	channel(eventFd),
+	opener(0),
+	backoff(0),
+	retry(0),
+	loop(loop_),
+	coalescer(coalescer_)
+    {
+	g_io_add_watch(channel, G_IO_IN, inputThat, this);
+	opener = g_thread_new("CEC open", openThat, this);
+    }
+    ~CecInput() {
+	if (retry) {
+	    g_source_remove(retry);
+	}
+	g_thread_join(opener);
+    }
+};
+
+/// A ListeningSocket listens for local connections
+/// on a TCP port of the loopback interface
+/// or on a Unix domain socket path (an address with a '/').
+class ListeningSocket {
+public:
+    int fd;
+    ListeningSocket(char const * address) throw(boost::system::system_error)
+    :
+	fd(-1)
+    {
+	if (strchr(address, '/')) {
+	    sockaddr_un un;
+	    memset(&un, 0, sizeof un);
+	    un.sun_family = AF_UNIX;
+	    strncpy(un.sun_path, address, sizeof un.sun_path - 1);
+	    // replace a socket left behind (but nothing else)
+	    struct stat status;
+	    if (!lstat(un.sun_path, &status) && S_ISSOCK(status.st_mode)) {
+		unlink(un.sun_path);
+	    }
+	    fd = SystemException::throwErrorIfNegative1(
+		socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+		0));
+	    SystemException::throwErrorIfNegative1(
+		bind(fd, reinterpret_cast<sockaddr *>(&un), sizeof un));
+	} else {
+	    char * end;
+	    errno = 0;
+	    unsigned long port = strtoul(address, &end, 10);
+	    if (!*address || *end || errno || !port || 65535 < port
+		    || strchr(address, '-')) {
+		throw boost::system::system_error(EINVAL,
+		    boost::system::system_category(),
+		    std::string(address) + ": not a port (1-65535) or path");
+	    }
+	    sockaddr_in in;
+	    memset(&in, 0, sizeof in);
+	    in.sin_family = AF_INET;
+	    in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	    in.sin_port = htons(port);
+	    fd = SystemException::throwErrorIfNegative1(
+		socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+		0));
+	    int on = 1;
+	    SystemException::throwErrorIfNegative1(
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof on));
+	    SystemException::throwErrorIfNegative1(
+		bind(fd, reinterpret_cast<sockaddr *>(&in), sizeof in));
+	}
+	SystemException::throwErrorIfNegative1(listen(fd, 4));
+    }
+    operator int() const {return fd;}
+    ~ListeningSocket() {close(fd);}
+};
+
+/// A MetricsServer object is created to serve Output metrics over HTTP
+/// from a local socket (a TCP port on the loopback interface
+/// or a Unix domain socket path).
+/// Every request, whatever it is, gets the metrics in response.
+/// All I/O is non-blocking and handled by our GMainLoop.
+class MetricsServer {
+private:
+    class Channel {
+    private:
+	GIOChannel * channel;
+    public:
+	Channel(int fd) : channel(g_io_channel_unix_new(fd)) {}
+	operator GIOChannel * () const {return channel;}
+	~Channel() {g_io_channel_unref(channel);}
+    };
+    enum {
+	Clients	= 16,	///< open at once, at most
+	Timeout	= 10	///< seconds for a client to be served
+    };
+    /// A Client is created for each accepted connection.
+    /// It reads a request (up to the end of its header),
+    /// writes the response and deletes itself
+    /// (or is deleted if that takes too long).
+    class Client {
+    private:
+	MetricsServer &	server;
+	int		fd;
+	Channel		channel;
+	std::string	request;
+	std::string	response;
+	size_t		written;
+	guint		watch;
+	guint		timer;
+	gboolean io(GIOCondition condition) {
+	    if (response.empty()) {
+		char buffer[1024];
+		ssize_t length;
+		while (0 < (length = read(fd, buffer, sizeof buffer))) {
+		    request.append(buffer, length);
+		}
+		bool eof = 0 == length
+		    || (0 > length && EAGAIN != errno)
+		    || (condition & (G_IO_HUP | G_IO_ERR));
+		if (std::string::npos == request.find("\r\n\r\n")
+			&& std::string::npos == request.find("\n\n")
+			&& !eof && sizeof buffer * 8 > request.size()) {
+		    return true;	// for more of the request
+		}
+		std::ostringstream body;
+		server.output.printMetrics(body);
+		std::ostringstream response_;
+		response_
+		    << "HTTP/1.0 200 OK\r\n"
+		    << "Content-Type: text/plain; version=0.0.4\r\n"
+		    << "Content-Length: " << std::dec << body.str().size()
+			<< "\r\n"
+		    << "Connection: close\r\n"
+		    << "\r\n"
+		    << body.str();
+		response = response_.str();
+		// continue by writing when writable
+		watch = g_io_add_watch(channel,
+		    static_cast<GIOCondition>(G_IO_OUT | G_IO_HUP | G_IO_ERR),
+		    ioThat, this);
+		return false;
+	    }
+	    // a client that has gone away must not kill us with SIGPIPE
+	    ssize_t length = send(fd,
+		response.data() + written, response.size() - written,
+		MSG_NOSIGNAL);
+	    if (0 < length) {
+		written += length;
+	    } else if (0 > length && EAGAIN == errno) {
+		return true;
 	    }
-	    if (!get()->Open(port, timeout)) {
-		throw std::runtime_error("CEC::ICECAdapter::Open failed");
+	    if (0 > length || response.size() == written
+		    || (condition & (G_IO_HUP | G_IO_ERR))) {
+		watch = 0;
+		delete this;
+		return false;
 	    }
+	    return true;
 	}
-	~Adapter() {
-	    if (get()) {
-		get()->Close();
+	static gboolean ioThat(
+	    GIOChannel *	source,
+	    GIOCondition	condition,
+	    gpointer		that)
+	{
+	    return static_cast<Client *>(that)->io(condition);
+	}
+	static gboolean expireThat(gpointer that) {
+	    Client * client = static_cast<Client *>(that);
+	    client->timer = 0;
+	    delete client;
+	    return false;
+	}
+	~Client() {
+	    if (watch) {
+		g_source_remove(watch);
 	    }
+	    if (timer) {
+		g_source_remove(timer);
+	    }
+	    close(fd);
+	    --server.clients;
 	}
-    };
-    class Pipe {
     public:
-	int fds[2];
-	Pipe() throw(std::runtime_error) : fds{-1, -1} {
-	    SystemException::throwErrorIfNegative1(pipe2(fds, O_CLOEXEC));
-	    SystemException::throwErrorIfNegative1(
-		fcntl(fds[0], F_SETFL, O_NONBLOCK
-		    | SystemException::throwErrorIfNegative1(
-			fcntl(fds[0], F_GETFL, 0))));
+	Client(MetricsServer & server_, int fd_)
+	:
+	    server(server_),
+	    fd(fd_),
+	    channel(fd),
+	    request(),
+	    response(),
+	    written(0),
+	    watch(0),
+	    timer(0)
+	{
+	    ++server.clients;
+	    watch = g_io_add_watch(channel,
+		static_cast<GIOCondition>(G_IO_IN | G_IO_HUP | G_IO_ERR),
+		ioThat, this);
+	    timer = g_timeout_add_seconds(Timeout, expireThat, this);
 	}
-	~Pipe() {
-	    close(fds[0]);
-	    close(fds[1]);
+    };
+    ListeningSocket	socket_;
+    Channel		channel;
+    Output &		output;
+    size_t		clients;	///< open
+    gboolean accept() {
+	int fd;
+	while (0 <= (fd = accept4(socket_, 0, 0,
+		SOCK_NONBLOCK | SOCK_CLOEXEC))) {
+	    if (Clients <= clients) {
+		close(fd);
+		continue;
+	    }
+	    new Client(*this, fd);
 	}
+	return true;
+    }
+    static gboolean acceptThat(
+	GIOChannel *	source,
+	GIOCondition	condition,
+	gpointer	that)
+    {
+	return static_cast<MetricsServer *>(that)->accept();
+    }
+public:
+    MetricsServer(
+	char const *	address,
+	Output &	output_)
+    throw(boost::system::system_error)
+    :
+	socket_(address),
+	channel(socket_),
+	output(output_),
+	clients(0)
+    {
+	g_io_add_watch(channel, G_IO_IN, acceptThat, this);
+    }
+};
+
+/// A CommandInput object is created to accept operations from local
+/// clients (e.g., home automation or load generators) on a socket.
+/// Each line that a client writes is an operation, as in a lircrc config
+/// (e.g., "VolumeUp 3"), optionally followed by @PATTERN to direct it
+/// to the renderers whose names match regular expression PATTERN
+/// (ignoring case) rather than to those selected (e.g., "Mute @Kitchen").
+/// Each line is a discrete press, so volume steps do not ramp up.
+/// Nothing is written back so a client may write as many lines
+/// as it likes without waiting (but none longer than Line).
+/// Like those of other inputs, the operations read at once
+/// are coalesced and performed as a batch.
+class CommandInput {
+private:
+    enum {
+	Reads	= 16,	///< of a client, at most, per wake up
+	Line	= 4096	///< bytes of a line, at most
     };
     class Channel {
     private:
@@ -811,114 +4362,607 @@ private:
 	operator GIOChannel * () const {return channel;}
 	~Channel() {g_io_channel_unref(channel);}
     };
-    gboolean input(
-	GIOChannel *	source,
-	GIOCondition	condition)
-    {
-	// batch up operations
-	int play		= 0;
-	int next		= 0;
-	int volumeAdjustment	= 0;
-	bool toggleMute		= false;
-	try {
-	    while (true) {
-		CEC::cec_user_control_code queue[4096];
-		ssize_t length = SystemException::throwErrorIfNegative1(
-		    read(pipe.fds[0], &queue, sizeof queue));
-		if (0 == length) {
-		    std::cerr << "\tCEC pipe closed, exiting" << std::endl;
-		    g_main_loop_quit(loop.get());
-		} else {
-		    for (CEC::cec_user_control_code const * c = queue;
-			    0 < length; ++c, length -= sizeof(*c)) {
-			switch (*c) {
-			    case CEC::CEC_USER_CONTROL_CODE_PLAY:
-				++play; break;
-			    case CEC::CEC_USER_CONTROL_CODE_PAUSE:
-				--play; break;
-			    case CEC::CEC_USER_CONTROL_CODE_FORWARD:
-				++next; break;
-			    case CEC::CEC_USER_CONTROL_CODE_BACKWARD:
-				--next; break;
-			    case CEC::CEC_USER_CONTROL_CODE_VOLUME_UP:
-				++volumeAdjustment; break;
-			    case CEC::CEC_USER_CONTROL_CODE_VOLUME_DOWN:
-				--volumeAdjustment; break;
-			    case CEC::CEC_USER_CONTROL_CODE_MUTE:
-				toggleMute = !toggleMute; break;
-			    default:
-				break;
-			}
-		    }
+    /// A Client is created for each accepted connection.
+    /// It reads lines until the connection is closed
+    /// and then deletes itself.
+    class Client {
+    private:
+	CommandInput &	input;
+	int		fd;
+	Channel		channel;
+	std::string	buffer;		///< of a partial line
+	gboolean io(GIOCondition condition) {
+	    gint64 time = g_get_monotonic_time();
+	    char chunk[4096];
+	    ssize_t length = 0;
+	    for (size_t reads = 0; Reads > reads
+		    && 0 < (length = read(fd, chunk, sizeof chunk)); ++reads) {
+		buffer.append(chunk, length);
+		std::string::size_type begin = 0, end;
+		while (std::string::npos
+			!= (end = buffer.find('\n', begin))) {
+		    input.perform(buffer.substr(begin, end - begin), time);
+		    begin = end + 1;
+		}
+		buffer.erase(0, begin);
+		if (Line < buffer.size()) {
+		    break;
 		}
 	    }
-	} catch (boost::system::system_error & e) {
-	    if (boost::system::errc::resource_unavailable_try_again
-		    != e.code()) {
-		std::cerr << e.what() << std::endl;
-		std::cerr << "\tCEC pipe error, exiting" << std::endl;
-		g_main_loop_quit(loop.get());
+	    bool overlong = Line < buffer.size();
+	    if (overlong) {
+		std::cerr << "\tcommand:\tline longer than " << std::dec
+		    << static_cast<int>(Line) << " bytes, disconnecting"
+		    << std::endl;
 	    }
+	    bool eof = overlong || 0 == length || (0 > length
+		&& (EAGAIN != errno || (condition & G_IO_ERR)));
+	    if (eof && !overlong && !buffer.empty()) {
+		input.perform(buffer, time);
+	    }
+	    input.commit();
+	    if (eof) {
+		delete this;
+		return false;
+	    }
+	    return true;
 	}
-	// perform batched up operations
-	if (play) {
-	    0 > play ? output.pause() : output.play();
+	static gboolean ioThat(
+	    GIOChannel *	source,
+	    GIOCondition	condition,
+	    gpointer		that)
+	{
+	    return static_cast<Client *>(that)->io(condition);
 	}
-	if (next) {
-	    0 > next ? output.previous() : output.next();
+	~Client() {close(fd);}
+    public:
+	Client(CommandInput & input_, int fd_)
+	:
+	    input(input_),
+	    fd(fd_),
+	    channel(fd),
+	    buffer()
+	{
+	    g_io_add_watch(channel,
+		static_cast<GIOCondition>(G_IO_IN | G_IO_HUP | G_IO_ERR),
+		ioThat, this);
+	}
+    };
+    size_t		verbose;
+    ListeningSocket	socket_;
+    Channel		channel;
+    Output &		output;
+    Coalescer &		coalescer;
+    bool		targeting;	///< selection replaced by target
+    std::string		target;		///< pattern
+    std::string		selection;	///< pattern (to restore)
+    void select(std::string const & pattern) {
+	Operations::Command command
+	    = {Operations::table + Operations::Renderer, 0, pattern};
+	coalescer.perform(
+	    Metrics::getInstance()->getInput("command"), command, 0);
+    }
+    /// restore the selection (if replaced by a target)
+    void untarget() {
+	if (targeting) {
+	    targeting = false;
+	    select(selection);
+	}
+    }
+    void perform(std::string line, gint64 time) {
+	if (!line.empty() && '\r' == line[line.size() - 1]) {
+	    line.erase(line.size() - 1);
+	}
+	if (std::string::npos == line.find_first_not_of(" \t")) {
+	    return;
+	}
+	if (verbose) {
+	    std::cout << "\tcommand:\t" << line << std::endl;
+	}
+	Metrics::InputMetrics & metrics
+	    = Metrics::getInstance()->getInput("command");
+	++metrics.received;
+	std::string::size_type at = line.rfind('@');
+	bool targeted = std::string::npos != at
+	    && (!at || ' ' == line[at - 1] || '\t' == line[at - 1]);
+	std::string pattern;
+	if (targeted) {
+	    pattern = line.substr(at + 1);
+	    line.erase(at ? line.find_last_not_of(" \t", at - 1) + 1 : 0);
+	}
+	Operations::Command command;
+	if (!Operations::parse(line.c_str(), command)) {
+	    std::cerr << "\tcommand:\t" << line << ": unsupported"
+		<< std::endl;
+	    return;
 	}
-	if (volumeAdjustment) {
-	    output.setRelativeVolume(2 * volumeAdjustment);
+	if (!targeted) {
+	    untarget();
+	} else if (!targeting || target != pattern) {
+	    if (!targeting) {
+		targeting = true;
+		selection = output.getSelection();
+	    }
+	    target = pattern;
+	    select(target);
 	}
-	if (toggleMute) {
-	    output.toggleMute();
+	// each line is a discrete press (not a repeat of a held one)
+	coalescer.release();
+	coalescer.perform(metrics, command, time);
+    }
+    void commit() {
+	untarget();
+	coalescer.commit();
+    }
+    gboolean accept() {
+	int fd;
+	while (0 <= (fd = accept4(socket_, 0, 0,
+		SOCK_NONBLOCK | SOCK_CLOEXEC))) {
+	    new Client(*this, fd);
 	}
 	return true;
     }
-    static gboolean inputThat(
+    static gboolean acceptThat(
 	GIOChannel *	source,
 	GIOCondition	condition,
 	gpointer	that)
     {
-	return static_cast<CecInput *>(that)->input(source, condition);
+	return static_cast<CommandInput *>(that)->accept();
     }
-    size_t				verbose;
-    Adapter				adapter;
-    Pipe				pipe;
-    Channel				channel;
-    boost::shared_ptr<GMainLoop>	loop;
-    Output &				output;
 public:
-    CecInput(
+    CommandInput(
+	size_t		verbose_,
+	char const *	address,
+	Output &	output_,
+	Coalescer &	coalescer_)
+    throw(boost::system::system_error)
+    :
+	verbose(verbose_),
+	socket_(address),
+	channel(socket_),
+	output(output_),
+	coalescer(coalescer_),
+	targeting(false),
+	target(),
+	selection()
+    {
+	g_io_add_watch(channel, G_IO_IN, acceptThat, this);
+    }
+};
+
+/// A Benchmark object is created to inject synthetic input into Output,
+/// once discovery of matching renderers has settled,
+/// and report the throughput and latencies of the renderer actions
+/// that result before quitting our GMainLoop.
+/// Injected operations cycle through VolumeUp, VolumeDown, Play and Pause
+/// so that renderer state does not drift.
+class Benchmark {
+private:
+    enum {
+	Poll	= 100,	///< milliseconds between discovery checks
+	Settle	= 10	///< checks without change before we begin
+    };
+    size_t			verbose;
+    unsigned int		events;		///< to inject
+    unsigned int		interval;	///< milliseconds between them
+    unsigned int		injected;
+    size_t			renderers;	///< at the last check
+    unsigned int		settled;	///< checks without change
+    gint64			begun;
+    Metrics::ActionMetrics	before;		///< when begun
+    boost::shared_ptr<GMainLoop> loop;
+    Output &			output;
+    gboolean discover() {
+	size_t renderers_ = output.getRenderers();
+	if (!renderers_ || renderers != renderers_ || !output.isIdle()) {
+	    renderers = renderers_;
+	    settled = 0;
+	    return true;
+	}
+	if (Settle > ++settled) {
+	    return true;
+	}
+	if (verbose) {
+	    std::cout << "benchmark: begin with " << std::dec << renderers
+		<< " renderers" << std::endl;
+	}
+	before = Metrics::getInstance()->getTotal();
+	begun = g_get_monotonic_time();
+	if (interval) {
+	    g_timeout_add(interval, injectThat, this);
+	} else {
+	    g_idle_add(injectThat, this);
+	}
+	return false;
+    }
+    static gboolean discoverThat(gpointer that) {
+	return static_cast<Benchmark *>(that)->discover();
+    }
+    gboolean inject() {
+	gint64 input = g_get_monotonic_time();
+	switch (injected++ % 4) {
+	    case 0:	output.setRelativeVolume(+1, input);	break;
+	    case 1:	output.setRelativeVolume(-1, input);	break;
+	    case 2:	output.play(input);			break;
+	    case 3:	output.pause(input);			break;
+	}
+	if (events > injected) {
+	    return true;
+	}
+	g_timeout_add(1, drainThat, this);
+	return false;
+    }
+    static gboolean injectThat(gpointer that) {
+	return static_cast<Benchmark *>(that)->inject();
+    }
+    gboolean drain() {
+	if (!output.isIdle()) {
+	    return true;
+	}
+	gint64 elapsed = g_get_monotonic_time() - begun;
+	Metrics::ActionMetrics after = Metrics::getInstance()->getTotal();
+	uint64_t ended = after.ended - before.ended;
+	double seconds = elapsed / 1e6;
+	std::cout << std::dec
+	    << "benchmark: " << renderers << " renderers" << std::endl
+	    << "benchmark: " << injected << " events in " << seconds
+		<< " s (" << injected / seconds << "/s)" << std::endl
+	    << "benchmark: " << ended << " actions ended ("
+		<< after.failed - before.failed << " failed) ("
+		<< ended / seconds << "/s)" << std::endl
+	    << "benchmark: http connections reused: "
+		<< Metrics::getInstance()->getHttpReuse() << "%" << std::endl
+	    << "benchmark: end to end (microseconds): "
+		<< after.endToEnd << std::endl;
+	g_main_loop_quit(loop.get());
+	return false;
+    }
+    static gboolean drainThat(gpointer that) {
+	return static_cast<Benchmark *>(that)->drain();
+    }
+public:
+    Benchmark(
 	size_t				verbose_,
-	char const *			name,
-	char const *			port,
-	uint32_t			timeout,
+	unsigned int			events_,
+	unsigned int			interval_,
 	boost::shared_ptr<GMainLoop>	loop_,
 	Output &			output_)
     :
 	verbose(verbose_),
-	adapter(this, name, port, timeout),
-	pipe(),
-	channel(pipe.fds[0]),
+	events(events_),
+	interval(interval_),
+	injected(0),
+	renderers(0),
+	settled(0),
+	begun(0),
+	before(),
 	loop(loop_),
 	output(output_)
     {
-	g_io_add_watch(channel, G_IO_IN, inputThat, this);
+	g_timeout_add(Poll, discoverThat, this);
+    }
+};
+
+/// A Soak object is created to sample, while renderers come and go,
+/// what Output keeps for them and fail if it grows.
+/// Samples taken over the first quarter of the soak set the limits
+/// for proxies not yet finalized (beyond those of live services)
+/// and for resident memory (plus Slack percent).
+/// Live services must always be those of available renderers.
+class Soak {
+private:
+    enum {
+	Sample	= 10,	///< seconds between samples
+	Slack	= 10	///< percent of resident memory allowed to grow
+    };
+    size_t			verbose;
+    unsigned int		samples;	///< to take
+    unsigned int		taken;
+    unsigned int		warmUp;		///< samples that set limits
+    int64_t			proxies;	///< most during warmUp
+    uint64_t			resident;	///< most during warmUp
+    bool			failed;
+    boost::shared_ptr<GMainLoop> loop;
+    Output &			output;
+    gboolean sample() {
+	Metrics const * metrics = Metrics::getInstance();
+	int64_t services = metrics->services;
+	int64_t proxies_ = metrics->proxies - services;
+	uint64_t resident_ = Metrics::getResidentBytes();
+	size_t registered = output.getServices();
+	++taken;
+	if (verbose) {
+	    std::cout << std::dec << "soak: " << taken << "/" << samples
+		<< " renderers " << output.getRenderers()
+		<< " services " << services
+		<< " proxies " << metrics->proxies
+		<< " resident " << resident_ << std::endl;
+	}
+	if (static_cast<int64_t>(registered) != services) {
+	    std::cerr << "soak: " << services << " services alive for "
+		<< registered << " of renderers" << std::endl;
+	    failed = true;
+	}
+	if (warmUp >= taken) {
+	    proxies = std::max(proxies, proxies_);
+	    resident = std::max(resident, resident_);
+	    return true;
+	}
+	if (samples > taken) {
+	    return true;
+	}
+	if (proxies < proxies_) {
+	    std::cerr << "soak: proxies not finalized grew from "
+		<< proxies << " to " << proxies_ << std::endl;
+	    failed = true;
+	}
+	if (resident * (100 + Slack) / 100 < resident_) {
+	    std::cerr << "soak: resident memory grew from "
+		<< resident << " to " << resident_ << std::endl;
+	    failed = true;
+	}
+	std::cout << "soak: " << (failed ? "failed" : "passed") << std::endl;
+	g_main_loop_quit(loop.get());
+	return false;
+    }
+    static gboolean sampleThat(gpointer that) {
+	return static_cast<Soak *>(that)->sample();
+    }
+public:
+    Soak(
+	size_t				verbose_,
+	unsigned int			seconds,
+	boost::shared_ptr<GMainLoop>	loop_,
+	Output &			output_)
+    :
+	verbose(verbose_),
+	samples(std::max<unsigned int>(2, seconds / Sample)),
+	taken(0),
+	warmUp(std::max<unsigned int>(1, samples / 4)),
+	proxies(0),
+	resident(0),
+	failed(false),
+	loop(loop_),
+	output(output_)
+    {
+	g_timeout_add_seconds(Sample, sampleThat, this);
+    }
+    bool hasFailed() const {return failed;}
+};
+
+/// A Replay object is created to give a Coalescer what a Trace recorded,
+/// once discovery of matching renderers has settled,
+/// at the times recorded (or as fast as possible, a batch at a time)
+/// and report the latencies of the renderer actions that result
+/// before quitting our GMainLoop.
+/// Operations are given with the time they are given (not that recorded)
+/// so that their latencies are measured from then.
+/// So, fast, they are given without their recorded gaps and a held
+/// volume key ramps (and is rate limited) differently than it did.
+class Replay {
+private:
+    enum {
+	Poll	= 100,	///< milliseconds between discovery checks
+	Settle	= 10	///< checks without change before we begin
+    };
+    typedef std::vector<Trace::Event>		Events;
+    typedef std::vector<Metrics::InputMetrics *> Sources;
+    size_t			verbose;
+    bool			fast;
+    Events			events;
+    Sources			sources;
+    size_t			next;		///< event
+    size_t			renderers;	///< at the last check
+    unsigned int		settled;	///< checks without change
+    gint64			begun;
+    Metrics::ActionMetrics	before;		///< when begun
+    boost::shared_ptr<GMainLoop> loop;
+    Output &			output;
+    Coalescer &			coalescer;
+    gboolean discover() {
+	size_t renderers_ = output.getRenderers();
+	if (!renderers_ || renderers != renderers_ || !output.isIdle()) {
+	    renderers = renderers_;
+	    settled = 0;
+	    return true;
+	}
+	if (Settle > ++settled) {
+	    return true;
+	}
+	if (verbose) {
+	    std::cout << "replay: begin with " << std::dec << renderers
+		<< " renderers" << std::endl;
+	}
+	before = Metrics::getInstance()->getTotal();
+	begun = g_get_monotonic_time();
+	if (fast) {
+	    g_idle_add(replayThat, this);
+	} else {
+	    replay();
+	}
+	return false;
+    }
+    static gboolean discoverThat(gpointer that) {
+	return static_cast<Replay *>(that)->discover();
+    }
+    void give(Trace::Event const & event, gint64 time) {
+	switch (event.kind) {
+	    case Trace::Source:
+		if (sources.size() <= event.source) {
+		    sources.resize(event.source + 1);
+		}
+		sources[event.source]
+		    = &Metrics::getInstance()->getInput(event.text.c_str());
+		break;
+	    case Trace::Perform: {
+		Operations::Command command
+		    = {Operations::table + event.code,
+			event.integer, event.text};
+		coalescer.perform(*sources[event.source], command, time);
+		break;
+	    }
+	    case Trace::Release:
+		coalescer.release();
+		break;
+	    case Trace::Commit:
+		coalescer.commit();
+		break;
+	}
+    }
+    /// give what is due (or, if fast, the next batch)
+    gboolean replay() {
+	gint64 now = g_get_monotonic_time();
+	while (events.size() > next) {
+	    Trace::Event const & event = events[next];
+	    if (!fast && begun + event.time > now) {
+		g_timeout_add((begun + event.time - now + 999) / 1000,
+		    replayThat, this);
+		return false;
+	    }
+	    ++next;
+	    give(event, now);
+	    if (fast && Trace::Commit == event.kind) {
+		return true;
+	    }
+	}
+	g_timeout_add(1, drainThat, this);
+	return false;
+    }
+    static gboolean replayThat(gpointer that) {
+	return static_cast<Replay *>(that)->replay();
+    }
+    gboolean drain() {
+	if (!output.isIdle()) {
+	    return true;
+	}
+	gint64 elapsed = g_get_monotonic_time() - begun;
+	Metrics::ActionMetrics after = Metrics::getInstance()->getTotal();
+	uint64_t ended = after.ended - before.ended;
+	double seconds = elapsed / 1e6;
+	std::cout << std::dec
+	    << "replay: " << renderers << " renderers" << std::endl
+	    << "replay: " << events.size() << " events in " << seconds
+		<< " s" << std::endl
+	    << "replay: " << ended << " actions ended ("
+		<< after.failed - before.failed << " failed) ("
+		<< ended / seconds << "/s)" << std::endl
+	    << "replay: http connections reused: "
+		<< Metrics::getInstance()->getHttpReuse() << "%" << std::endl
+	    << "replay: end to end (microseconds): "
+		<< after.endToEnd << std::endl;
+	g_main_loop_quit(loop.get());
+	return false;
+    }
+    static gboolean drainThat(gpointer that) {
+	return static_cast<Replay *>(that)->drain();
+    }
+public:
+    Replay(
+	size_t				verbose_,
+	char const *			path,
+	bool				fast_,
+	boost::shared_ptr<GMainLoop>	loop_,
+	Output &			output_,
+	Coalescer &			coalescer_)
+    throw(std::runtime_error)
+    :
+	verbose(verbose_),
+	fast(fast_),
+	events(),
+	sources(),
+	next(0),
+	renderers(0),
+	settled(0),
+	begun(0),
+	before(),
+	loop(loop_),
+	output(output_),
+	coalescer(coalescer_)
+    {
+	std::ifstream file(path, std::ios::binary);
+	char magic[Trace::MagicSize];
+	if (!file.read(magic, sizeof magic)
+		|| memcmp(magic, Trace::magic(), sizeof magic)) {
+	    throw std::runtime_error(std::string(path) + ": not a trace");
+	}
+	// validate as we read so that we need not as we give
+	size_t sources_ = 0;
+	Trace::Event event;
+	while (Trace::read(file, event)) {
+	    if (Trace::Source == event.kind) {
+		sources_ = std::max<size_t>(sources_, event.source + 1);
+	    } else if (Trace::Perform == event.kind
+		    && (Operations::Count <= event.code
+			|| sources_ <= event.source)) {
+		throw std::runtime_error(std::string(path) + ": corrupt");
+	    } else if (Trace::Commit < event.kind) {
+		throw std::runtime_error(std::string(path) + ": corrupt");
+	    }
+	    events.push_back(event);
+	}
+	// begin with the first event (not when recording began)
+	gint64 first = events.empty() ? 0 : events.front().time;
+	for (Events::iterator it = events.begin(); events.end() != it; ++it) {
+	    it->time -= first;
+	}
+	if (verbose) {
+	    std::cout << "replay: " << std::dec << events.size()
+		<< " events read" << std::endl;
+	}
+	g_timeout_add(Poll, discoverThat, this);
     }
 };
 
+/// print latencies of output (on SIGUSR1)
+static gboolean printLatencies(gpointer output) {
+    static_cast<Output *>(output)->printLatencies(std::cout);
+    return G_SOURCE_CONTINUE;
+}
+
+/// quit loop (on SIGINT or SIGTERM)
+static gboolean quit(gpointer loop) {
+    g_main_loop_quit(static_cast<GMainLoop *>(loop));
+    return G_SOURCE_CONTINUE;
+}
+
+/// log that our loop is running (once)
+static gboolean loopRunning(gpointer) {
+    startupPhase("main loop running");
+    return G_SOURCE_REMOVE;
+}
+
 int main(int argc, char ** argv) {
+    static std::string const actionsOption	("actions");
+    static std::string const actionsOptions	( actionsOption		+ ",a");
+    static std::string const absoluteOption	("absolute");
+    static std::string const groupOption	("group");
+    static std::string const groupVolumeOption	("group-volume");
+    static std::string const benchmarkOption	("benchmark");
+    static std::string const benchmarkIntervalOption	("benchmark-interval");
+    static std::string const soakOption		("soak");
+    static std::string const recordOption	("record");
+    static std::string const replayOption	("replay");
+    static std::string const replayFastOption	("replay-fast");
+    static std::string const idleTimeoutOption	("idle-timeout");
     static std::string const helpOption		("help");
     static std::string const helpOptions	( helpOption		+ ",h");
     static std::string const manOption		("man");
     static std::string const manOptions		( manOption		+ ",m");
+    static std::string const cacheOption	("cache");
     static std::string const cecOption		("cec");
     static std::string const cecOptions		( cecOption		+ ",c");
+    static std::string const commandOption	("command");
+    static std::string const evdevOption	("evdev");
+    static std::string const evdevGrabOption	("evdev-grab");
     static std::string const interfaceOption	("interface");
     static std::string const interfaceOptions	( interfaceOption	+ ",i");
     static std::string const lircrcOption	("lircrc");
     static std::string const lircrcOptions	( lircrcOption		+ ",l");
+    static std::string const metricsOption	("metrics");
+    static std::string const preconnectOption	("preconnect");
+    static std::string const rampCurveOption	("ramp-curve");
+    static std::string const rampRateOption	("ramp-rate");
+    static std::string const rampStepOption	("ramp-step");
     static std::string const nameOption		("name");
     static std::string const nameOptions	( nameOption		+ ",n");
     static std::string const programOption	("program");
@@ -931,13 +4975,23 @@ int main(int argc, char ** argv) {
     static std::string const timeoutOptions	( timeoutOption		+ ",t");
     static std::string const verboseOption	("verbose");
     static std::string const verboseOptions	( verboseOption		+ ",v");
+    static std::string const windowOption	("window");
+    static std::string const windowOptions	( windowOption		+ ",w");
 
+    static unsigned int const actionsDefault	(2);
+    static unsigned int const benchmarkIntervalDefault	(10);
+    static std::string const cacheDefault	("");
     static std::string const cecDefault		("");
     static std::string const interfaceDefault	("");
     static std::string const lircrcDefault	("");
     static unsigned int const serverDefault	(0);
     static std::string const rendererDefault	("(?i).*\\s-\\ssonos\\s.*");
     static unsigned int const timeoutDefault	(10000);
+    static unsigned int const idleTimeoutDefault	(300);
+    static double const rampCurveDefault	(1);
+    static unsigned int const rampRateDefault	(10);
+    static unsigned int const rampStepDefault	(10);
+    static unsigned int const windowDefault	(0);
 
     try {
 	char const * slash = strrchr(*argv, '/');
@@ -945,6 +4999,15 @@ int main(int argc, char ** argv) {
 	std::string const programDefault	(basename);
 	std::string const nameDefault		(basename);
 
+	std::ostringstream actionsUsage; actionsUsage
+	    << "renderer actions in flight, at most (default: "
+	    << actionsDefault << ").";
+	std::ostringstream benchmarkIntervalUsage; benchmarkIntervalUsage
+	    << "milliseconds between benchmark events (default: "
+	    << benchmarkIntervalDefault << "); 0 => as fast as possible.";
+	std::ostringstream cacheUsage; cacheUsage
+	    << "renderer cache file (default: "
+	    << cacheDefault << "); \"\" => no cache.";
 	std::ostringstream cecUsage; cecUsage
 	    << "CEC adapter com port (see cec-client -l output) (default: "
 	    << cecDefault << "); \"\" => default, \"-\" => no CEC input.";
@@ -973,21 +5036,101 @@ int main(int argc, char ** argv) {
 	    << "CEC connection timeout in milliseconds (default: "
 	    << timeoutDefault << ").";
 
+	std::ostringstream idleTimeoutUsage; idleTimeoutUsage
+	    << "seconds to keep an idle renderer connection (default: "
+	    << idleTimeoutDefault << "); 0 => forever.";
+	std::ostringstream rampCurveUsage; rampCurveUsage
+	    << "volume step growth per second a key is held (default: "
+	    << rampCurveDefault << "); 0 => no acceleration.";
+	std::ostringstream rampRateUsage; rampRateUsage
+	    << "volume writes per second, at most (default: "
+	    << rampRateDefault << "); 0 => no limit.";
+	std::ostringstream rampStepUsage; rampStepUsage
+	    << "volume step of a held key, at most (default: "
+	    << rampStepDefault << ").";
+	std::ostringstream windowUsage; windowUsage
+	    << "input coalescing window in milliseconds (default: "
+	    << windowDefault << "); 0 => only input read at once.";
+
 	boost::program_options::options_description options("Options");
 	    options.add_options()
 		(helpOptions.c_str(),
 		    "Print options usage.")
 		(manOptions.c_str(),
 		    "Print man(ual) page.")
+		(actionsOptions.c_str(),
+		    boost::program_options::value<unsigned int>(),
+		    actionsUsage.str().c_str())
+		(absoluteOption.c_str(),
+		    "Set absolute volume (from that known) "
+		    "rather than adjusting it relatively.")
+		(groupOption.c_str(),
+		    "Send transport operations to Sonos group coordinators only.")
+		(groupVolumeOption.c_str(),
+		    "Adjust the volume of a Sonos group through its coordinator "
+		    "(implies group).")
+		(benchmarkOption.c_str(),
+		    boost::program_options::value<unsigned int>(),
+		    "Inject this many synthetic events once renderers are "
+		    "discovered, report throughput and latencies, then exit.")
+		(benchmarkIntervalOption.c_str(),
+		    boost::program_options::value<unsigned int>(),
+		    benchmarkIntervalUsage.str().c_str())
+		(soakOption.c_str(),
+		    boost::program_options::value<unsigned int>(),
+		    "Watch for this many seconds that what is kept for renderers "
+		    "does not grow as they come and go, then exit (with failure "
+		    "if it does).")
+		(recordOption.c_str(),
+		    boost::program_options::value<std::string>(),
+		    "Record a trace of input operations to this file.")
+		(replayOption.c_str(),
+		    boost::program_options::value<std::string>(),
+		    "Replay the input operations of this trace file once "
+		    "renderers are discovered, report latencies, then exit.")
+		(replayFastOption.c_str(),
+		    "Replay as fast as possible (a batch at a time) rather than "
+		    "at the times recorded.")
+		(idleTimeoutOption.c_str(),
+		    boost::program_options::value<unsigned int>(),
+		    idleTimeoutUsage.str().c_str())
+		(cacheOption.c_str(),
+		    boost::program_options::value<std::string>(),
+		    cacheUsage.str().c_str())
 		(cecOptions.c_str(),
 		    boost::program_options::value<std::string>(),
 		    cecUsage.str().c_str())
+		(commandOption.c_str(),
+		    boost::program_options::value<std::string>(),
+		    "Accept operations, a line each, on a loopback TCP port "
+		    "or a Unix domain socket path (with a '/').")
+		(evdevOption.c_str(),
+		    boost::program_options::value<std::string>(),
+		    "Linux input event device (or file of recorded events) "
+		    "to read keys from.")
+		(evdevGrabOption.c_str(),
+		    "Grab the input event device for our use alone.")
 		(interfaceOptions.c_str(),
 		    boost::program_options::value<std::string>(),
 		    interfaceUsage.str().c_str())
 		(lircrcOptions.c_str(),
 		    boost::program_options::value<std::string>(),
 		    lircrcUsage.str().c_str())
+		(metricsOption.c_str(),
+		    boost::program_options::value<std::string>(),
+		    "Serve metrics over HTTP on a loopback TCP port "
+		    "or a Unix domain socket path (with a '/').")
+		(preconnectOption.c_str(),
+		    "Connect to each renderer as soon as it is known.")
+		(rampCurveOption.c_str(),
+		    boost::program_options::value<double>(),
+		    rampCurveUsage.str().c_str())
+		(rampRateOption.c_str(),
+		    boost::program_options::value<unsigned int>(),
+		    rampRateUsage.str().c_str())
+		(rampStepOption.c_str(),
+		    boost::program_options::value<unsigned int>(),
+		    rampStepUsage.str().c_str())
 		(nameOptions.c_str(),
 		    boost::program_options::value<std::string>(),
 		    nameUsage.str().c_str())
@@ -1005,6 +5148,9 @@ int main(int argc, char ** argv) {
 		    timeoutUsage.str().c_str())
 		(verboseOptions.c_str(),
 		    "Print trace messages.")
+		(windowOptions.c_str(),
+		    boost::program_options::value<unsigned int>(),
+		    windowUsage.str().c_str())
 	;
 	boost::program_options::variables_map variablesMap;
 	boost::program_options::store(
@@ -1039,6 +5185,8 @@ int main(int argc, char ** argv) {
 "	A libcec compatible HDMI CEC protocol adapter must be installed\n"
 "	to relay remote/button codes from your remote.\n"
 "	Specify --cec=- if there is no such input.\n"
+"	If the connection to the adapter is lost, it is reopened\n"
+"	(retrying with backoff) while renderers remain known.\n"
 "\n"
 "	The LIRC daemon (lircd) must be configured (and running)\n"
 "	to receive remote/button codes for your remote.\n"
@@ -1047,10 +5195,38 @@ int main(int argc, char ** argv) {
 "	or found in one of the default locations)\n"
 "	to operations supported by this program (" << program << ").\n"
 "	Specify --lircrc=- if there is no such input.\n"
+"	If the connection to lircd drops, it is made again\n"
+"	(retrying with backoff). The lircrc file is read again on SIGHUP\n"
+"	and, if specified, whenever it changes; until a reading succeeds,\n"
+"	the last one is used.\n"
+"\n"
+"	With the evdev option, keys are read directly from a Linux input\n"
+"	event device, such as one to which the kernel decodes infrared\n"
+"	(see ir-keytable), without lircd. With the evdev-grab option,\n"
+"	they are read by this program alone. A file of events recorded\n"
+"	from such a device (e.g., by cat) may be read instead.\n"
+"\n"
+"	With the command option, operations are accepted from local\n"
+"	clients (such as home automation) on a socket, one per line,\n"
+"	as in a lircrc config. An operation may be followed by @PATTERN\n"
+"	to direct it to the renderers whose names match regular expression\n"
+"	PATTERN anywhere (ignoring case) rather than to those selected\n"
+"	(e.g., Mute @Kitchen). Each line is a separate press (it does not\n"
+"	hold a key). Nothing is written back, so lines may be written\n"
+"	without waiting (e.g., socat - UNIX-CONNECT:/run/r2upnpav.sock).\n"
+"	A client that writes a line longer than 4096 bytes is disconnected.\n"
 "\n"
 "	The UPnP media renderer device(s) to be targeted by each operation\n"
 "	are specified as those whose friendly names\n"
 "	match a renderer regular expression pattern.\n"
+"	With the group option, the topology of Sonos zone groups is learned\n"
+"	and transport operations are sent only to the coordinator of a group\n"
+"	(unless it does not match or is not selected).\n"
+"	With the group-volume option, the volume of such a group is adjusted\n"
+"	through its coordinator, in proportion, with one action.\n"
+"	With the cache option, matching renderers are remembered\n"
+"	so that, on restart, they may be used before they are rediscovered.\n"
+"	Those not rediscovered within 30 seconds are forgotten.\n"
 "\n"
 "	Use the verbose program option to trace program operations.\n"
 "	This includes UPnP device discovery with device friendly names\n"
@@ -1064,10 +5240,90 @@ int main(int argc, char ** argv) {
 "	Unfortunately, for UPnP discovery, an ephemeral UDP port is used.\n"
 "	Since this port cannot be known/specified in advance, the firewall\n"
 "	must allow all UDP incoming traffic to the ephemeral port range.\n"
+"\n"
+"	Operations from all inputs are coalesced (play and pause cancel,\n"
+"	volume adjustments add up, ...) into as few renderer actions\n"
+"	as possible. By default, only input that is read at once is\n"
+"	coalesced. With a window, input from both LIRC and CEC\n"
+"	(e.g., from the same remote) is coalesced for that long.\n"
+"\n"
+"	While a volume key is held, its steps grow (see ramp-curve)\n"
+"	up to a limit (see ramp-step) and volume is written no more often\n"
+"	than allowed (see ramp-rate); adjustments that come sooner\n"
+"	are added to the next write.\n"
+"\n"
+"	Connections to renderers are kept alive (until idle for too long)\n"
+"	and reused. With the preconnect option, one is made as soon as\n"
+"	a renderer is known so that the first operation need not wait.\n"
+"\n"
+"	The transport state of each renderer is tracked so that play,\n"
+"	pause and stop actions that would not change it are not sent\n"
+"	and so that a play/pause toggle knows which to send.\n"
+"\n"
+"	With the verbose option, the time at which each startup phase ends\n"
+"	is printed.\n"
+"	HTTP connection reuse and the latencies of each operation\n"
+"	of each renderer (queued, round trip and end to end, from input)\n"
+"	are printed, in microseconds, on SIGUSR1 and at exit.\n"
+"\n"
+"	With the benchmark option, synthetic events are injected\n"
+"	once renderer discovery settles and the resulting throughput\n"
+"	and end to end latency percentiles are printed before exit.\n"
+"	Run against fakerenderer(s) on the loopback interface\n"
+"	(make benchmark) for a reproducible baseline.\n"
+"\n"
+"	With the record option, the operations of all inputs (as they are\n"
+"	given to be coalesced, with when they were given) are written\n"
+"	to a compact binary trace file. With the replay option,\n"
+"	those of a trace are given again (instead of or along with live\n"
+"	input) once renderer discovery settles, at the times recorded\n"
+"	or, with the replay-fast option, as fast as possible,\n"
+"	and end to end latency percentiles are printed before exit.\n"
+"	A fast replay drops the recorded gaps between operations, so\n"
+"	held volume keys ramp (and are limited, see ramp-rate)\n"
+"	differently than when recorded.\n"
+"	Run against fakerenderer(s) on the loopback interface\n"
+"	(make benchmark-replay) for a repeatable workload.\n"
+"\n"
+"	With the soak option, the renderer services alive, their proxies\n"
+"	not yet finalized and our resident memory are sampled while\n"
+"	renderers come and go. Exit is with failure if services outlive\n"
+"	their renderers or if proxies or memory grow beyond what they were\n"
+"	after the first quarter of the soak (memory by more than 10%).\n"
+"	Run against flapping fakerenderers on the loopback interface\n"
+"	(make soak).\n"
 "\n"
 	    << options
 	    <<
 "\n"
+"OPERATIONS\n"
+"	Each lircrc config is one of the following operations\n"
+"	(named without regard to case, with any parameter after it).\n"
+"	CEC keys map to those with a CEC key listed.\n"
+"	Input event device keys map to Play (KEY_PLAY, KEY_PLAYCD),\n"
+"	Pause (KEY_PAUSE, KEY_PAUSECD), PlayPause (KEY_PLAYPAUSE),\n"
+"	Stop (KEY_STOP, KEY_STOPCD), Next (KEY_NEXT, KEY_NEXTSONG,\n"
+"	KEY_FASTFORWARD), Previous (KEY_PREVIOUS, KEY_PREVIOUSSONG,\n"
+"	KEY_REWIND), Mute (KEY_MUTE), VolumeUp (KEY_VOLUMEUP)\n"
+"	and VolumeDown (KEY_VOLUMEDOWN).\n"
+"		Play			CEC PLAY\n"
+"		Pause			CEC PAUSE\n"
+"		PlayPause		CEC PAUSE_PLAY_FUNCTION (toggle)\n"
+"		Stop			CEC STOP\n"
+"		Next			CEC FORWARD\n"
+"		Previous		CEC BACKWARD\n"
+"		Seek H:MM:SS		seek to a time in the current track\n"
+"		Mute			CEC MUTE (toggle)\n"
+"		VolumeUp [N]		up by N (1 - 100), default 1,\n"
+"					CEC VOLUME_UP (N = 2)\n"
+"		VolumeDown [N]		down by N (1 - 100), default 1,\n"
+"					CEC VOLUME_DOWN (N = 2)\n"
+"		Volume N		set volume to N (0 - 100)\n"
+"		Renderer [PATTERN]	select renderers whose names match\n"
+"					regular expression PATTERN anywhere\n"
+"					(ignoring case) for operations\n"
+"					that follow (all, if none)\n"
+"\n"
 "LIRCRC EXAMPLES\n"
 "	The following lircrc file maps typical (standard, irrecord named)\n"
 "	lircd (remote/button) codes to supported (config'ed)\n"
@@ -1126,9 +5382,22 @@ int main(int argc, char ** argv) {
 	    return 0;
 	}
 
+	unsigned int actions(variablesMap.count(actionsOption)
+	    ? variablesMap[actionsOption].as<unsigned int>()
+	    : actionsDefault);
+	std::string cache(variablesMap.count(cacheOption)
+	    ? variablesMap[cacheOption].as<std::string>()
+	    : cacheDefault);
 	std::string cec(variablesMap.count(cecOption)
 	    ? variablesMap[cecOption].as<std::string>()
 	    : cecDefault);
+	std::string command(variablesMap.count(commandOption)
+	    ? variablesMap[commandOption].as<std::string>()
+	    : "");
+	std::string evdev(variablesMap.count(evdevOption)
+	    ? variablesMap[evdevOption].as<std::string>()
+	    : "");
+	bool evdevGrab = variablesMap.count(evdevGrabOption);
 	std::string interface(variablesMap.count(interfaceOption)
 	    ? variablesMap[interfaceOption].as<std::string>()
 	    : interfaceDefault);
@@ -1148,17 +5417,75 @@ int main(int argc, char ** argv) {
 	    ? variablesMap[timeoutOption].as<unsigned int>()
 	    : timeoutDefault);
 	size_t verbose = variablesMap.count(verboseOption);
+	unsigned int window(variablesMap.count(windowOption)
+	    ? variablesMap[windowOption].as<unsigned int>()
+	    : windowDefault);
+	std::string metrics(variablesMap.count(metricsOption)
+	    ? variablesMap[metricsOption].as<std::string>()
+	    : "");
+	bool absolute = variablesMap.count(absoluteOption);
+	bool group = variablesMap.count(groupOption);
+	bool groupVolume = variablesMap.count(groupVolumeOption);
+	unsigned int idleTimeout(variablesMap.count(idleTimeoutOption)
+	    ? variablesMap[idleTimeoutOption].as<unsigned int>()
+	    : idleTimeoutDefault);
+	bool preconnect = variablesMap.count(preconnectOption);
+	double rampCurve(variablesMap.count(rampCurveOption)
+	    ? variablesMap[rampCurveOption].as<double>()
+	    : rampCurveDefault);
+	unsigned int rampRate(variablesMap.count(rampRateOption)
+	    ? variablesMap[rampRateOption].as<unsigned int>()
+	    : rampRateDefault);
+	unsigned int rampStep(variablesMap.count(rampStepOption)
+	    ? variablesMap[rampStepOption].as<unsigned int>()
+	    : rampStepDefault);
+	unsigned int benchmark(variablesMap.count(benchmarkOption)
+	    ? variablesMap[benchmarkOption].as<unsigned int>()
+	    : 0);
+	unsigned int benchmarkInterval(variablesMap.count(benchmarkIntervalOption)
+	    ? variablesMap[benchmarkIntervalOption].as<unsigned int>()
+	    : benchmarkIntervalDefault);
+	unsigned int soak(variablesMap.count(soakOption)
+	    ? variablesMap[soakOption].as<unsigned int>()
+	    : 0);
+	std::string record(variablesMap.count(recordOption)
+	    ? variablesMap[recordOption].as<std::string>()
+	    : "");
+	std::string replay(variablesMap.count(replayOption)
+	    ? variablesMap[replayOption].as<std::string>()
+	    : "");
+	bool replayFast = variablesMap.count(replayFastOption);
+
+	startupVerbose = verbose;
+	startupPhase("options parsed");
 
 	boost::shared_ptr<GMainLoop> loop(
 	    g_main_loop_new(0, true),
 	    g_main_loop_unref);
 
-	// glue inputs and output together
+	// glue inputs and output together.
+	// nothing here blocks for long (our CEC adapter is opened off-thread)
+	// so that discovery and input are live as soon as our loop runs.
 	Output output(
 	    verbose,
 	    interface.empty() ? 0 : interface.c_str(),
 	    server,
-	    renderer);
+	    renderer,
+	    actions,
+	    absolute,
+	    group,
+	    groupVolume,
+	    cache,
+	    idleTimeout,
+	    preconnect);
+	startupPhase("UPnP discovery started");
+	Coalescer coalescer(verbose, window, output,
+	    rampCurve, rampStep, rampRate);
+	boost::shared_ptr<Recorder> recorder;
+	if (!record.empty()) {
+	    recorder.reset(new Recorder(record.c_str()));
+	    coalescer.record(recorder.get());
+	}
 	boost::shared_ptr<CecInput> cecInput;
 	if ("-" != cec) {
 	    cecInput.reset(new CecInput(
@@ -1167,7 +5494,8 @@ int main(int argc, char ** argv) {
 		cec.empty() ? 0 : cec.c_str(),
 		timeout,
 		loop,
-		output));
+		coalescer));
+	    startupPhase("CEC adapter opening");
 	}
 	boost::shared_ptr<LircInput> lircInput;
 	if ("-" != lircrc) {
@@ -1176,11 +5504,71 @@ int main(int argc, char ** argv) {
 		program.c_str(),
 		lircrc.empty() ? 0 : lircrc.c_str(),
 		loop,
+		coalescer));
+	    startupPhase("LIRC connected");
+	}
+	boost::shared_ptr<EvdevInput> evdevInput;
+	if (!evdev.empty()) {
+	    evdevInput.reset(new EvdevInput(
+		verbose,
+		evdev.c_str(),
+		evdevGrab,
+		coalescer));
+	    startupPhase("input event device opened");
+	}
+	boost::shared_ptr<CommandInput> commandInput;
+	if (!command.empty()) {
+	    commandInput.reset(new CommandInput(
+		verbose,
+		command.c_str(),
+		output,
+		coalescer));
+	}
+
+	boost::shared_ptr<MetricsServer> metricsServer;
+	if (!metrics.empty()) {
+	    metricsServer.reset(new MetricsServer(metrics.c_str(), output));
+	}
+
+	boost::shared_ptr<Benchmark> benchmark_;
+	if (benchmark) {
+	    benchmark_.reset(new Benchmark(
+		verbose,
+		benchmark,
+		benchmarkInterval,
+		loop,
 		output));
 	}
 
+	boost::shared_ptr<Replay> replay_;
+	if (!replay.empty()) {
+	    replay_.reset(new Replay(
+		verbose,
+		replay.c_str(),
+		replayFast,
+		loop,
+		output,
+		coalescer));
+	}
+
+	boost::shared_ptr<Soak> soak_;
+	if (soak) {
+	    soak_.reset(new Soak(verbose, soak, loop, output));
+	}
+
+	g_unix_signal_add(SIGUSR1,	printLatencies,	&output);
+	g_unix_signal_add(SIGINT,	quit,		loop.get());
+	g_unix_signal_add(SIGTERM,	quit,		loop.get());
+	g_idle_add(loopRunning, 0);
+
 	g_main_loop_run(loop.get());
 
+	output.printLatencies(std::cout);
+
+	if (soak_ && soak_->hasFailed()) {
+	    return -1;
+	}
+
     } catch (std::exception & e) {
 	std::cerr << e.what() << std::endl;
 	return -1;
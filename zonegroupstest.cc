@@ -0,0 +1,87 @@
+/// \file
+/// \brief Definition of zonegroupstest program
+///
+/// A zonegroupstest checks that ZoneGroups works out, for renderers
+/// in Sonos zone groups, the coordinators that operations are sent to
+/// (by r2upnpav, with its group option) among those selected.
+
+#include <iostream>
+#include <vector>
+
+#include "ZoneGroups.h"
+
+/// A Renderer is what ZoneGroups needs of r2upnpav's
+struct Renderer {
+    std::string	zone;
+    bool	selected;
+    bool	coordinates;
+    bool	coordinatesOthers;
+};
+
+/// A Case is a selection of renderers in the Kitchen group
+/// (coordinated by Kitchen, with Den) and an ungrouped Patio
+/// and which of them should coordinate themselves (and others)
+struct Case {
+    char const *	name;
+    bool		selected[3];		///< Kitchen, Den, Patio
+    bool		coordinates[3];
+    bool		coordinatesOthers[3];
+};
+
+static Case const cases[] = {
+    {"all selected",
+	{true, true, true},	{true, false, true},	{true, false, false}},
+    {"coordinator selected",
+	{true, false, false},	{true, true, true},	{false, false, false}},
+    {"member selected, coordinator not",
+	{false, true, false},	{true, true, true},	{false, false, false}},
+    {"member and ungrouped selected, coordinator not",
+	{false, true, true},	{true, true, true},	{false, false, false}},
+};
+
+int main(int argc, char ** argv) {
+    static char const * const zones[] = {"Kitchen", "Den", "Patio"};
+    ZoneGroups::Coordinators coordinators;
+    coordinators["Kitchen"]	= "Kitchen";
+    coordinators["Den"]		= "Kitchen";
+
+    int status = 0;
+    for (size_t i = 0; i < sizeof cases / sizeof *cases; ++i) {
+	Case const & case_ = cases[i];
+	std::vector<Renderer> renderers;
+	for (size_t j = 0; j < 3; ++j) {
+	    Renderer renderer = {zones[j], case_.selected[j], false, false};
+	    renderers.push_back(renderer);
+	}
+	ZoneGroups::coordinate(coordinators, renderers);
+	for (size_t j = 0; j < 3; ++j) {
+	    if (case_.coordinates[j] != renderers[j].coordinates
+		    || case_.coordinatesOthers[j]
+			!= renderers[j].coordinatesOthers) {
+		std::cerr << case_.name << ": " << zones[j] << " coordinates "
+		    << renderers[j].coordinates << " "
+		    << renderers[j].coordinatesOthers << " not "
+		    << case_.coordinates[j] << " "
+		    << case_.coordinatesOthers[j] << std::endl;
+		status = -1;
+	    }
+	}
+    }
+
+    // a member whose coordinator is not a matching renderer
+    {
+	std::vector<Renderer> renderers;
+	Renderer den = {"Den", true, false, false};
+	renderers.push_back(den);
+	ZoneGroups::coordinate(coordinators, renderers);
+	if (!renderers[0].coordinates || renderers[0].coordinatesOthers) {
+	    std::cerr << "coordinator unknown: Den does not coordinate itself"
+		<< std::endl;
+	    status = -1;
+	}
+    }
+
+    std::cout << "zonegroupstest: " << (status ? "failed" : "passed")
+	<< std::endl;
+    return status;
+}